@@ -0,0 +1,6 @@
+#ifndef _BENCH_ZEPHYR_SYS_UTIL_H_
+#define _BENCH_ZEPHYR_SYS_UTIL_H_
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+#endif
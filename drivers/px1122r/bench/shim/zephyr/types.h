@@ -0,0 +1,7 @@
+#ifndef _BENCH_ZEPHYR_TYPES_H_
+#define _BENCH_ZEPHYR_TYPES_H_
+
+// Just enough of Zephyr for the parser to build on the host.
+#include <stdint.h>
+
+#endif
@@ -0,0 +1,157 @@
+#include "skytraq_parser.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zephyr/sys/util.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLES 1
+#endif
+
+// Enough frames that a run takes a good fraction of a second.
+#define STREAM_SIZE (8 * 1024 * 1024)
+#define RUNS 5
+
+// Navigation data every epoch, and raw measurements for 32 channels.
+#define NAV_DATA_PAYLOAD_LEN 59
+#define RAW_MEAS_PAYLOAD_LEN (3 + 32 * 23)
+
+static uint32_t frames_seen;
+
+static void frame_cb(const uint8_t* payload, uint16_t len, void* user_data) {
+    (void)len;
+    (void)user_data;
+
+    // Touch the payload so the copy can't be optimised away.
+    frames_seen += payload[0] != 0;
+}
+
+static uint8_t checksum(const uint8_t* payload, uint16_t len) {
+    uint8_t cs = 0;
+
+    for (uint16_t i = 0; i < len; ++i) {
+        cs ^= payload[i];
+    }
+
+    return cs;
+}
+
+static size_t put_frame(uint8_t* out, uint8_t msg_id, uint16_t payload_len) {
+    uint8_t* payload = &out[4];
+
+    out[0] = 0xa0;
+    out[1] = 0xa1;
+    out[2] = payload_len >> 8;
+    out[3] = payload_len & 0xff;
+    payload[0] = msg_id;
+
+    for (uint16_t i = 1; i < payload_len; ++i) {
+        payload[i] = (uint8_t)rand();
+    }
+
+    payload[payload_len] = checksum(payload, payload_len);
+    payload[payload_len + 1] = 0x0d;
+    payload[payload_len + 2] = 0x0a;
+
+    return payload_len + 7;
+}
+
+static uint64_t now(void) {
+#ifdef HAVE_CYCLES
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+// Feeds the stream in chunks the size the UART hands over, the way the driver's worker does.
+static uint64_t run(struct skytraq_parser_t* parser, const uint8_t* stream, size_t len, size_t chunk) {
+    uint64_t start = now();
+
+    for (size_t offset = 0; offset < len; offset += chunk) {
+        const uint8_t* p = &stream[offset];
+        size_t remaining = MIN(chunk, len - offset);
+
+        while (remaining > 0) {
+            size_t consumed = skytraq_parser_feed(parser, p, remaining);
+
+            // A frame abandoned on the first byte hands it back. Nothing in this stream should be.
+            if (consumed == 0) {
+                consumed = 1;
+            }
+
+            p += consumed;
+            remaining -= consumed;
+        }
+    }
+
+    return now() - start;
+}
+
+int main(void) {
+    static const size_t chunks[] = {16, 64, 256, 4096};
+    uint8_t* stream = malloc(STREAM_SIZE);
+    size_t len = 0;
+    uint32_t frames = 0;
+
+    if (stream == NULL) {
+        return 1;
+    }
+
+    srand(1);
+
+    while (len + RAW_MEAS_PAYLOAD_LEN + 7 + NAV_DATA_PAYLOAD_LEN + 7 <= STREAM_SIZE) {
+        len += put_frame(&stream[len], 0xa8, NAV_DATA_PAYLOAD_LEN);
+        len += put_frame(&stream[len], 0xe5, RAW_MEAS_PAYLOAD_LEN);
+        frames += 2;
+    }
+
+#ifdef HAVE_CYCLES
+    const char* unit = "cycle";
+#else
+    const char* unit = "ns";
+#endif
+
+    printf("%zu bytes, %u frames\n", len, frames);
+
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); ++c) {
+        uint64_t best = UINT64_MAX;
+
+        for (int r = 0; r < RUNS; ++r) {
+            struct skytraq_parser_t* parser = malloc(sizeof(*parser));
+
+            if (parser == NULL) {
+                free(stream);
+                return 1;
+            }
+
+            skytraq_parser_init(parser, frame_cb, NULL);
+            frames_seen = 0;
+
+            uint64_t elapsed = run(parser, stream, len, chunks[c]);
+
+            if (parser->frames != frames || frames_seen != frames || parser->checksum_errors != 0) {
+                printf("Parsed %u of %u frames, %u checksum errors\n", parser->frames, frames,
+                       parser->checksum_errors);
+                free(parser);
+                free(stream);
+                return 1;
+            }
+
+            best = MIN(best, elapsed);
+            free(parser);
+        }
+
+        printf("%5zu byte chunks: %.3f bytes/%s\n", chunks[c], (double)len / best, unit);
+    }
+
+    free(stream);
+
+    return 0;
+}
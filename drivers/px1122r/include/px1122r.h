@@ -2,15 +2,338 @@
 #define _PX1122R_H_
 
 #include <zephyr/device.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/net/buf.h>
+#include <zephyr/sys/byteorder.h>
+#include <string.h>
 
-typedef void (* px1122r_callback_t)(const uint8_t* buf, uint16_t len);
+enum px1122r_msg_type_t {
+    PX1122R_MSG_NMEA,
+    PX1122R_MSG_RTCM3,
+    // A SkyTraq binary output message that isn't a command response. buf is the payload, starting with the ID.
+    PX1122R_MSG_SKYTRAQ,
+    // A position fix decoded by the driver, from a navigation data message or from a whole epoch of NMEA. buf points
+    // at a struct px1122r_fix_t.
+    PX1122R_MSG_FIX
+};
+
+// Compact position fix. Everything is fixed point so it can go over the air as is.
+struct px1122r_fix_t {
+    // 0 no fix, 1 2D, 2 3D, 3 3D with differential corrections.
+    uint8_t fix_mode;
+    uint8_t num_sv;
+    uint16_t gps_week;
+    // GPS time of week in milliseconds.
+    uint32_t tow_ms;
+    // Degrees * 1e7.
+    int32_t latitude;
+    int32_t longitude;
+    // Centimetres.
+    int32_t ellipsoid_height;
+    int32_t altitude_msl;
+    // Dilution of precision * 100.
+    uint16_t pdop;
+    uint16_t hdop;
+    uint16_t vdop;
+    // Centimetres and centimetres per second.
+    int32_t ecef_x;
+    int32_t ecef_y;
+    int32_t ecef_z;
+    int32_t ecef_vx;
+    int32_t ecef_vy;
+    int32_t ecef_vz;
+    // The rest only come from NMEA. GGA quality indicator: 0 invalid, 1 GPS, 2 DGPS, 4 RTK fixed, 5 RTK float.
+    uint8_t quality;
+    // PX1122R_FIX_FROM_* bits saying which sentences went into this fix.
+    uint8_t sources;
+    // UTC milliseconds since midnight, and the date as ddmmyy.
+    uint32_t utc_time_ms;
+    uint32_t utc_date;
+    // Millimetres per second and degrees * 100.
+    uint32_t ground_speed;
+    uint16_t course;
+    // Standard deviations in centimetres, saturating at UINT16_MAX.
+    uint16_t latitude_sd;
+    uint16_t longitude_sd;
+    uint16_t altitude_sd;
+    // Age of the differential corrections the fix used, in hundredths of a second. 0 without any.
+    uint16_t correction_age;
+} __attribute__((packed));
+
+#define PX1122R_FIX_FROM_GGA BIT(0)
+#define PX1122R_FIX_FROM_RMC BIT(1)
+#define PX1122R_FIX_FROM_GST BIT(2)
+#define PX1122R_FIX_FROM_GSA BIT(3)
+#define PX1122R_FIX_FROM_NAV_DATA BIT(7)
+
+struct px1122r_meas_time_t {
+    uint8_t iod;
+    uint16_t week;
+    uint32_t tow_ms;
+    uint16_t period_ms;
+};
+
+struct px1122r_raw_meas_t {
+    uint8_t svid;
+    uint8_t cn0;
+    // Metres, cycles and Hz.
+    double pseudorange;
+    double carrier_phase;
+    float doppler;
+    uint8_t channel_indicator;
+};
+
+// A 1PPS edge, timestamped against the local cycle counter. The edge happened offset_ns before the counter read
+// cycles, which lets a consumer place it to well under a microsecond even though k_cycle_get_32() may tick much more
+// slowly than that.
+struct px1122r_pps_edge_t {
+    uint32_t cycles;
+    uint32_t offset_ns;
+    // Counts up from 1 with every edge. 0 means no edge has been seen.
+    uint32_t sequence;
+};
+
+// A complete, checksum-validated message from the receiver. buf points into the driver's RX buffers and is only valid
+// for the duration of the callback, so copy anything you need to keep.
+struct px1122r_msg_t {
+    enum px1122r_msg_type_t type;
+    const uint8_t* buf;
+    uint16_t len;
+    // k_cycle_get_32() when the UART handed over the last byte of the message, for measuring latency downstream.
+    uint32_t timestamp;
+    // The last 1PPS edge before the message arrived, which is the top of the second the message's epoch belongs to.
+    // The epoch's time of validity is that edge plus the sub-second part of its time of week.
+    struct px1122r_pps_edge_t pps;
+    union {
+        // For proprietary sentences the talker is "P" followed by a NUL and the sentence is the manufacturer code,
+        // so $PSTI,... has talker "P" and sentence "STI".
+        struct {
+            char talker[2];
+            char sentence[3];
+        } nmea;
+        // buf covers the whole frame, from the 0xd3 preamble to the end of the CRC.
+        struct {
+            uint16_t msg_type;
+        } rtcm3;
+        struct {
+            uint8_t msg_id;
+        } skytraq;
+    };
+};
+
+typedef void (* px1122r_callback_t)(const struct px1122r_msg_t* msg);
 
 int px1122r_start_stream(const struct device* dev, px1122r_callback_t cb);
 
 int px1122r_stop_stream(const struct device* dev);
 
+// Called from the driver's work queue when a command has been ACKed (result 0), NACKed (-EBADMSG) or not answered
+// in time (-ETIMEDOUT). For a batch it's called once, for the last command or for the first one that failed.
+typedef void (* px1122r_command_cb_t)(const struct device* dev, uint8_t msg_id, int result, void* user_data);
+
+struct px1122r_command_t {
+    const void* payload;
+    uint16_t length;
+    // How long to hold off the next command after this one is ACKed, for commands that restart the receiver.
+    uint16_t settle_ms;
+    // payload is already a complete frame, see PX1122R_FRAME.
+    bool framed;
+};
+
+#define PX1122R_COMMAND(cmd) {.payload = &(cmd), .length = sizeof(cmd), .settle_ms = 0}
+#define PX1122R_COMMAND_SETTLE(cmd, ms) {.payload = &(cmd), .length = sizeof(cmd), .settle_ms = ms}
+// A prebuilt frame is sent as is rather than copied, so it has to stay put until the command completes. In practice
+// that means a static const from PX1122R_FRAMED_COMMAND.
+#define PX1122R_FRAMED(frame) {.payload = (frame), .length = sizeof(frame), .settle_ms = 0, .framed = true}
+#define PX1122R_FRAMED_SETTLE(frame, ms) {.payload = (frame), .length = sizeof(frame), .settle_ms = ms, .framed = true}
+
+// Builds a whole SkyTraq frame, sync bytes to checksum and postamble, at compile time from the payload bytes. Multi-byte
+// fields are big-endian, PX1122R_BE16 and PX1122R_BE32 split them up.
+#define PX1122R_BE16(x) (((x) >> 8) & 0xff), ((x) & 0xff)
+#define PX1122R_BE32(x) (((x) >> 24) & 0xff), (((x) >> 16) & 0xff), (((x) >> 8) & 0xff), ((x) & 0xff)
+
+#define Z_PX1122R_FRAME_BYTE(x) ((uint8_t)(x))
+
+#define PX1122R_FRAME(...)                                                \
+    {0xa0, 0xa1, PX1122R_BE16(NUM_VA_ARGS_LESS_1(_, __VA_ARGS__)),        \
+    __VA_ARGS__,                                                          \
+    (uint8_t)(FOR_EACH(Z_PX1122R_FRAME_BYTE, (^), __VA_ARGS__)),          \
+    0x0d, 0x0a}
+
+#define PX1122R_FRAMED_COMMAND(name, ...) static const uint8_t name[] = PX1122R_FRAME(__VA_ARGS__)
+
+// Queues a command and returns straight away. The payload is copied, so it doesn't need to outlive the call.
+int px1122r_send_command_async(const struct device* dev, const void* command, uint16_t length, uint16_t settle_ms,
+                               px1122r_command_cb_t cb, void* user_data);
+
+// Queues a whole set of commands to go out back to back, stopping at the first one that fails. Either every command
+// is queued or, if there isn't room, none of them are.
+int px1122r_send_batch(const struct device* dev, const struct px1122r_command_t* commands, size_t count,
+                       px1122r_command_cb_t cb, void* user_data);
+
+// Queues a command and waits for the response. Don't call it from a px1122r callback.
 int px1122r_send_command(const struct device* dev, const void* command, const uint16_t length);
 
+struct px1122r_stats_t {
+    // Bytes handed to the RX worker.
+    uint32_t rx_bytes;
+    // Chunks dropped because the RX queue was full, and the bytes they held.
+    uint32_t rx_dropped_chunks;
+    uint32_t rx_dropped_bytes;
+    // Times the UART asked for a buffer and every DMA buffer was still in use.
+    uint32_t rx_overruns;
+    // Times the UART stopped receiving because of a line error.
+    uint32_t rx_errors;
+    // Highest number of chunks seen waiting for the worker.
+    uint16_t rx_queue_high_water;
+    // Current UART baud rate, and the receive rate measured over the last second or so.
+    uint32_t baudrate;
+    uint32_t rx_bytes_per_sec;
+    // NMEA sentences passed to the stream callback, and those thrown away.
+    uint32_t nmea_sentences;
+    uint32_t nmea_checksum_errors;
+    uint32_t nmea_framing_errors;
+    // Epochs of NMEA decoded into fixes, and sentences whose fields didn't make sense.
+    uint32_t nmea_fixes;
+    uint32_t nmea_field_errors;
+    // RTCM 3 frames passed to the stream callback, and those thrown away.
+    uint32_t rtcm3_frames;
+    uint32_t rtcm3_crc_errors;
+    uint32_t rtcm3_framing_errors;
+    // RTCM 3 correction frames sent to the receiver, those the UART failed to send, and those turned away because the
+    // queue was full.
+    uint32_t corrections_sent;
+    uint32_t corrections_failed;
+    uint32_t corrections_rejected;
+};
+
+int px1122r_get_stats(const struct device* dev, struct px1122r_stats_t* stats);
+
+// Gives back a frame passed to px1122r_send_corrections once the driver is done with it. Called from the driver's
+// work queue.
+typedef void (* px1122r_release_cb_t)(struct net_buf* buf);
+
+// Queues an RTCM 3 correction frame, in one buffer or a chain, for the receiver's second UART. The driver takes over
+// the caller's reference and sends straight from the buffers, handing the frame to release once it's out. The driver
+// never touches the reference count itself, so the caller decides how that's kept safe between threads. If
+// CONFIG_PX1122R_CORRECTIONS_QUEUE_SIZE frames are already waiting it returns -ENOBUFS and the reference stays with the
+// caller.
+int px1122r_send_corrections(const struct device* dev, struct net_buf* buf, px1122r_release_cb_t release);
+
+// Gets the most recent 1PPS edge. Returns -ENOTSUP if the board has no onepps-gpios and -ENODATA before the first edge.
+int px1122r_get_pps(const struct device* dev, struct px1122r_pps_edge_t* edge);
+
+// Finds the baud rate the receiver is using, then moves both ends of the link to the fastest rate up to
+// max_baudrate that still works. The receiver only keeps the new rate until it's power cycled. Blocks while it
+// talks to the receiver, so don't call it from a px1122r callback. Returns the rate in use, or a negative error.
+int px1122r_negotiate_baudrate(const struct device* dev, uint32_t max_baudrate);
+
+// Decoders for SkyTraq binary output messages. Each takes the payload as passed with PX1122R_MSG_SKYTRAQ and
+// returns -EINVAL if it isn't the right message or is too short.
+int px1122r_decode_nav_data(const uint8_t* payload, uint16_t len, struct px1122r_fix_t* fix);
+
+int px1122r_decode_meas_time(const uint8_t* payload, uint16_t len, struct px1122r_meas_time_t* meas_time);
+
+// Fills in up to max_meas channels and returns how many there were.
+int px1122r_decode_raw_meas(const uint8_t* payload, uint16_t len, struct px1122r_raw_meas_t* meas, size_t max_meas);
+
+#define PX1122R_MSG_ID_NAV_DATA 0xa8
+#define PX1122R_MSG_ID_MEAS_TIME 0xdc
+#define PX1122R_MSG_ID_RAW_MEAS 0xdd
+#define PX1122R_MSG_ID_SV_CH_STATUS 0xde
+#define PX1122R_MSG_ID_RCV_STATE 0xdf
+
+struct px1122r_cmd_query_sw_version_t {
+    uint8_t msg_id;
+    uint8_t software_type;
+} __attribute__((packed));
+
+#define PX1122R_QUERY_SW_VERSION {.msg_id = 0x02, .software_type = 0}
+#define PX1122R_FRAME_QUERY_SW_VERSION PX1122R_FRAME(0x02, 0)
+
+enum px1122r_baudrate_t {
+    BAUDRATE_4800,
+    BAUDRATE_9600,
+    BAUDRATE_19200,
+    BAUDRATE_38400,
+    BAUDRATE_57600,
+    BAUDRATE_115200,
+    BAUDRATE_230400,
+    BAUDRATE_460800,
+    BAUDRATE_921600
+};
+
+struct px1122r_cmd_serial_port_t {
+    uint8_t msg_id;
+    uint8_t com_port;
+    uint8_t baudrate;
+    uint8_t attributes;
+} __attribute__((packed));
+
+#define PX1122R_CONFIG_SERIAL_PORT(rate) {.msg_id = 0x05, .com_port = 0, .baudrate = rate, .attributes = 0}
+
+enum px1122r_message_type_t {
+    MESSAGE_TYPE_NONE,
+    MESSAGE_TYPE_NMEA,
+    MESSAGE_TYPE_BINARY
+};
+
+struct px1122r_cmd_message_type_t {
+    uint8_t msg_id;
+    uint8_t type;
+    uint8_t attributes;
+} __attribute__((packed));
+
+#define PX1122R_CONFIG_MESSAGE_TYPE(t) {.msg_id = 0x09, .type = t, .attributes = 0}
+#define PX1122R_FRAME_MESSAGE_TYPE(t) PX1122R_FRAME(0x09, t, 0)
+
+enum px1122r_meas_rate_t {
+    MEAS_RATE_1HZ,
+    MEAS_RATE_2HZ,
+    MEAS_RATE_4HZ,
+    MEAS_RATE_5HZ,
+    MEAS_RATE_10HZ,
+    MEAS_RATE_20HZ
+};
+
+struct px1122r_cmd_binary_meas_output_t {
+    uint8_t msg_id;
+    uint8_t output_rate;
+    uint8_t meas_time;
+    uint8_t raw_meas;
+    uint8_t sv_ch_status;
+    uint8_t rcv_state;
+    uint8_t subframe;
+    uint8_t extended_raw_meas;
+    uint8_t attributes;
+} __attribute__((packed));
+
+#define PX1122R_CONFIG_BINARY_MEAS_OUTPUT(rate, _meas_time, _raw_meas, _sv_ch_status, _rcv_state) \
+    {.msg_id = 0x1e, .output_rate = rate,                                                       \
+    .meas_time = _meas_time,                                                                    \
+    .raw_meas = _raw_meas,                                                                      \
+    .sv_ch_status = _sv_ch_status,                                                              \
+    .rcv_state = _rcv_state,                                                                    \
+    .subframe = 0,                                                                              \
+    .extended_raw_meas = 0,                                                                     \
+    .attributes = 0}
+#define PX1122R_FRAME_BINARY_MEAS_OUTPUT(rate, _meas_time, _raw_meas, _sv_ch_status, _rcv_state) \
+    PX1122R_FRAME(0x1e, rate, _meas_time, _raw_meas, _sv_ch_status, _rcv_state, 0, 0, 0)
+
+enum px1122r_rtk_mode_t {
+    RTK_MODE_ROVER,
+    RTK_MODE_BASE,
+    RTK_MODE_PRECISELY_KINEMATIC_BASE
+};
+
+// What the function field means in base mode. In rover mode 0 is normal, 1 float and 2 moving base.
+enum px1122r_rtk_base_function_t {
+    RTK_BASE_KINEMATIC,
+    RTK_BASE_SURVEY,
+    // Fixed at the latitude, longitude and ellipsoid height given in the command.
+    RTK_BASE_STATIC
+};
+
 struct px1122r_cmd_rtk_mode_t {
     uint8_t msg_id;
     uint8_t msg_sub_id;
@@ -18,24 +341,46 @@ struct px1122r_cmd_rtk_mode_t {
     uint8_t function;
     uint32_t survey_length;
     uint32_t std_dev;
-    double latitude;
-    double longitude;
-    float altitude;
-    float baseline_length;
+    // Big endian IEEE 754 doubles and floats, filled in by px1122r_rtk_mode_set_position.
+    uint8_t latitude[8];
+    uint8_t longitude[8];
+    uint8_t altitude[4];
+    uint8_t baseline_length[4];
     uint8_t attributes;
 } __attribute__((packed));
-#define PX1122R_CMD_RTK_MODE(_mode, _function, _survey_length, _std_dev, _latitude, _longitude, _altitude, _baseline_length) \
-    {.msg_id = 0x6a, .msg_sub_id = 0x06,                                                                                     \
-    .mode = _mode,                                                                                                           \
-    .function = _function,                                                                                                   \
-    .survey_length = sys_cpu_to_be32(_survey_length),                                                                        \
-    .std_dev = sys_cpu_to_be32(_std_dev),                                                                                    \
-    .latitude = _latitude,                                                                     \
-    .longitude = _longitude,                                                                   \
-    .altitude = _altitude,                                                                     \
-    .baseline_length = _baseline_length,                                                       \
+#define PX1122R_CMD_RTK_MODE(_mode, _function, _survey_length, _std_dev) \
+    {.msg_id = 0x6a, .msg_sub_id = 0x06,                               \
+    .mode = _mode,                                                     \
+    .function = _function,                                             \
+    .survey_length = sys_cpu_to_be32(_survey_length),                  \
+    .std_dev = sys_cpu_to_be32(_std_dev),                              \
     .attributes = 0}
 
+// Byte swapping the values themselves would convert them, it's their bits that have to go out.
+static inline void px1122r_rtk_mode_set_position(struct px1122r_cmd_rtk_mode_t* cmd, double latitude,
+                                                 double longitude, float altitude, float baseline_length) {
+    uint64_t bits64;
+    uint32_t bits32;
+
+    memcpy(&bits64, &latitude, sizeof(bits64));
+    sys_put_be64(bits64, cmd->latitude);
+    memcpy(&bits64, &longitude, sizeof(bits64));
+    sys_put_be64(bits64, cmd->longitude);
+    memcpy(&bits32, &altitude, sizeof(bits32));
+    sys_put_be32(bits32, cmd->altitude);
+    memcpy(&bits32, &baseline_length, sizeof(bits32));
+    sys_put_be32(bits32, cmd->baseline_length);
+}
+
+// Position update rate in Hz. The receiver accepts 1, 2, 4, 5, 8, 10 and 20.
+struct px1122r_cmd_position_rate_t {
+    uint8_t msg_id;
+    uint8_t rate;
+    uint8_t attributes;
+} __attribute__((packed));
+
+#define PX1122R_CONFIG_POSITION_RATE(hz) {.msg_id = 0x0e, .rate = hz, .attributes = 0}
+
 struct px1122r_cmd_psti_interval_t {
     uint8_t msg_id;
     uint8_t msg_sub_id;
@@ -46,6 +391,7 @@ struct px1122r_cmd_psti_interval_t {
 
 #define PX1122R_CONFIG_PSTI_MSG_INTERVAL(id, intv) \
     {.msg_id = 0x64, .msg_sub_id = 0x21, .psti_id = id, .interval = intv, .attributes = 0}
+#define PX1122R_FRAME_PSTI_MSG_INTERVAL(id, intv) PX1122R_FRAME(0x64, 0x21, id, intv, 0)
 
 enum px1122r_talker_id_t {
     TALKER_ID_GP_MODE,
@@ -60,6 +406,7 @@ struct px1122r_cmd_nmea_talker_id_t {
 } __attribute__((packed));
 
 #define PX1122R_CONFIG_NMEA_TALKER_ID(id) {.msg_id = 0x4b, .talker_id = id, .attributes = 0}
+#define PX1122R_FRAME_NMEA_TALKER_ID(id) PX1122R_FRAME(0x4b, id, 0)
 
 struct px1122r_config_extended_msg_interval_t {
     uint8_t msg_id;
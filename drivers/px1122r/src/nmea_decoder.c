@@ -0,0 +1,378 @@
+#include "nmea_decoder.h"
+
+#include <string.h>
+
+// GSA has the most, with the NMEA 4.1 system ID on the end.
+#define MAX_FIELDS 19
+
+#define KNOT_UM_PER_S 514444
+
+struct field_t {
+    const char* p;
+    uint8_t len;
+};
+
+// Splits everything between the "$" and the "*" at the commas. The first field is the address, e.g. "GNGGA".
+static size_t split_fields(const uint8_t* sentence, uint16_t len, struct field_t* fields) {
+    const char* p = (const char*)sentence + 1;
+    const char* end = memchr(p, '*', len - 1);
+    size_t count = 0;
+
+    if (end == NULL) {
+        return 0;
+    }
+
+    while (count < MAX_FIELDS) {
+        const char* comma = memchr(p, ',', end - p);
+        const char* field_end = comma != NULL ? comma : end;
+
+        fields[count].p = p;
+        fields[count].len = field_end - p;
+        ++count;
+
+        if (comma == NULL) {
+            break;
+        }
+
+        p = comma + 1;
+    }
+
+    return count;
+}
+
+// Parses "[-]123[.456]" into the value * 10^decimals, dropping any digits past that. Fails on an empty field or
+// anything that isn't a number.
+static bool parse_fixed(const struct field_t* field, uint8_t decimals, int64_t* value) {
+    const char* p = field->p;
+    const char* end = p + field->len;
+    bool negative = false;
+    int frac = -1;
+    int64_t v = 0;
+
+    if (p < end && *p == '-') {
+        negative = true;
+        ++p;
+    }
+
+    if (p == end) {
+        return false;
+    }
+
+    for (; p < end; ++p) {
+        if (*p == '.' && frac < 0) {
+            frac = 0;
+            continue;
+        }
+
+        if (*p < '0' || *p > '9' || v > INT64_MAX / 10 - 9) {
+            return false;
+        }
+
+        if (frac >= 0) {
+            if (frac == decimals) {
+                continue;
+            }
+
+            ++frac;
+        }
+
+        v = v * 10 + (*p - '0');
+    }
+
+    for (frac = MAX(frac, 0); frac < decimals; ++frac) {
+        v *= 10;
+    }
+
+    *value = negative ? -v : v;
+
+    return true;
+}
+
+static bool parse_optional(const struct field_t* field, uint8_t decimals, int64_t* value) {
+    if (field->len == 0) {
+        *value = 0;
+        return true;
+    }
+
+    return parse_fixed(field, decimals, value);
+}
+
+// "ddmm.mmmm" or "dddmm.mmmm" and a hemisphere into degrees * 1e7.
+static bool parse_coordinate(const struct field_t* field, const struct field_t* hemisphere, uint8_t degree_digits,
+                             int32_t* value) {
+    if (field->len <= degree_digits || hemisphere->len != 1) {
+        return false;
+    }
+
+    const struct field_t degrees_field = {.p = field->p, .len = degree_digits};
+    const struct field_t minutes_field = {.p = field->p + degree_digits, .len = field->len - degree_digits};
+    int64_t degrees;
+    int64_t minutes;
+
+    if (!parse_fixed(&degrees_field, 0, &degrees) || !parse_fixed(&minutes_field, 7, &minutes)) {
+        return false;
+    }
+
+    int64_t v = degrees * 10000000 + (minutes + 30) / 60;
+
+    switch (hemisphere->p[0]) {
+        case 'N':
+        case 'E':
+            break;
+        case 'S':
+        case 'W':
+            v = -v;
+            break;
+        default:
+            return false;
+    }
+
+    *value = (int32_t)v;
+
+    return true;
+}
+
+// "hhmmss.sss" into milliseconds since midnight.
+static bool parse_time(const struct field_t* field, uint32_t* ms) {
+    if (field->len < 6) {
+        return false;
+    }
+
+    const struct field_t hours_field = {.p = field->p, .len = 2};
+    const struct field_t minutes_field = {.p = field->p + 2, .len = 2};
+    const struct field_t seconds_field = {.p = field->p + 4, .len = field->len - 4};
+    int64_t hours;
+    int64_t minutes;
+    int64_t seconds;
+
+    if (!parse_fixed(&hours_field, 0, &hours) || !parse_fixed(&minutes_field, 0, &minutes) ||
+        !parse_fixed(&seconds_field, 3, &seconds)) {
+        return false;
+    }
+
+    *ms = (uint32_t)(((hours * 60 + minutes) * 60) * 1000 + seconds);
+
+    return true;
+}
+
+static uint16_t saturate_u16(int64_t v) {
+    return (uint16_t)CLAMP(v, 0, UINT16_MAX);
+}
+
+static bool decode_gga(struct px1122r_fix_t* fix, const struct field_t* fields, size_t count) {
+    int32_t latitude;
+    int32_t longitude;
+    int64_t quality;
+    int64_t num_sv;
+    int64_t hdop;
+    int64_t altitude;
+    int64_t separation;
+    int64_t age = 0;
+
+    if (count < 12 || !parse_fixed(&fields[6], 0, &quality)) {
+        return false;
+    }
+
+    fix->quality = quality;
+
+    // There's nothing else worth having without a fix, and the receiver leaves most of it empty anyway.
+    if (quality == 0) {
+        return true;
+    }
+
+    if (!parse_coordinate(&fields[2], &fields[3], 2, &latitude) ||
+        !parse_coordinate(&fields[4], &fields[5], 3, &longitude) ||
+        !parse_fixed(&fields[7], 0, &num_sv) ||
+        !parse_optional(&fields[8], 2, &hdop) ||
+        !parse_fixed(&fields[9], 2, &altitude) ||
+        !parse_optional(&fields[11], 2, &separation) ||
+        (count > 13 && !parse_optional(&fields[13], 2, &age))) {
+        return false;
+    }
+
+    fix->latitude = latitude;
+    fix->longitude = longitude;
+    fix->num_sv = num_sv;
+    fix->hdop = saturate_u16(hdop);
+    fix->altitude_msl = (int32_t)altitude;
+    fix->ellipsoid_height = (int32_t)(altitude + separation);
+    fix->correction_age = saturate_u16(age);
+
+    return true;
+}
+
+static bool decode_rmc(struct px1122r_fix_t* fix, const struct field_t* fields, size_t count) {
+    int32_t latitude;
+    int32_t longitude;
+    int64_t date;
+    int64_t speed;
+    int64_t course;
+
+    if (count < 10 || fields[2].len != 1) {
+        return false;
+    }
+
+    if (parse_fixed(&fields[9], 0, &date)) {
+        fix->utc_date = (uint32_t)date;
+    }
+
+    if (fields[2].p[0] != 'A') {
+        return true;
+    }
+
+    if (!parse_coordinate(&fields[3], &fields[4], 2, &latitude) ||
+        !parse_coordinate(&fields[5], &fields[6], 3, &longitude) ||
+        !parse_optional(&fields[7], 3, &speed) ||
+        !parse_optional(&fields[8], 2, &course)) {
+        return false;
+    }
+
+    fix->latitude = latitude;
+    fix->longitude = longitude;
+    // Thousandths of a knot to millimetres per second.
+    fix->ground_speed = (uint32_t)(speed * KNOT_UM_PER_S / 1000000);
+    fix->course = saturate_u16(course);
+
+    return true;
+}
+
+static bool decode_gst(struct px1122r_fix_t* fix, const struct field_t* fields, size_t count) {
+    int64_t latitude_sd;
+    int64_t longitude_sd;
+    int64_t altitude_sd;
+
+    if (count < 9 ||
+        !parse_fixed(&fields[6], 2, &latitude_sd) ||
+        !parse_fixed(&fields[7], 2, &longitude_sd) ||
+        !parse_fixed(&fields[8], 2, &altitude_sd)) {
+        return false;
+    }
+
+    fix->latitude_sd = saturate_u16(latitude_sd);
+    fix->longitude_sd = saturate_u16(longitude_sd);
+    fix->altitude_sd = saturate_u16(altitude_sd);
+
+    return true;
+}
+
+static bool decode_gsa(struct px1122r_fix_t* fix, const struct field_t* fields, size_t count) {
+    int64_t type;
+    int64_t pdop;
+    int64_t hdop;
+    int64_t vdop;
+
+    if (count < 18 || !parse_fixed(&fields[2], 0, &type) || type < 1 || type > 3) {
+        return false;
+    }
+
+    // 1 is no fix, 2 is 2D and 3 is 3D, one more than our fix modes.
+    fix->fix_mode = type - 1;
+
+    if (parse_fixed(&fields[15], 2, &pdop) && parse_fixed(&fields[16], 2, &hdop) &&
+        parse_fixed(&fields[17], 2, &vdop)) {
+        fix->pdop = saturate_u16(pdop);
+        fix->hdop = saturate_u16(hdop);
+        fix->vdop = saturate_u16(vdop);
+    }
+
+    return true;
+}
+
+static void publish(struct nmea_decoder_t* decoder) {
+    if (decoder->published || decoder->fix.sources == 0) {
+        return;
+    }
+
+    // A 3D fix with differential, RTK float or RTK fixed quality.
+    if (decoder->fix.fix_mode == 2 && decoder->fix.quality >= 2) {
+        decoder->fix.fix_mode = 3;
+    }
+
+    decoder->published = true;
+    decoder->epochs++;
+    decoder->callback(&decoder->fix, decoder->user_data);
+}
+
+static void start_epoch(struct nmea_decoder_t* decoder, uint32_t time_ms) {
+    memset(&decoder->fix, 0, sizeof(decoder->fix));
+    decoder->fix.utc_time_ms = time_ms;
+    decoder->epoch_time_ms = time_ms;
+    decoder->published = false;
+}
+
+void nmea_decoder_init(struct nmea_decoder_t* decoder, nmea_fix_cb_t callback, void* user_data) {
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->callback = callback;
+    decoder->user_data = user_data;
+    nmea_decoder_reset(decoder);
+}
+
+void nmea_decoder_reset(struct nmea_decoder_t* decoder) {
+    start_epoch(decoder, UINT32_MAX);
+    decoder->expected = 0;
+}
+
+void nmea_decoder_feed(struct nmea_decoder_t* decoder, const uint8_t* sentence, uint16_t len) {
+    struct field_t fields[MAX_FIELDS];
+    size_t count = split_fields(sentence, len, fields);
+    uint8_t source;
+    uint32_t time_ms;
+
+    // Any talker, so GP, GN, GL and friends all count.
+    if (count < 2 || fields[0].len != 5) {
+        return;
+    }
+
+    const char* type = &fields[0].p[2];
+
+    if (memcmp(type, "GGA", 3) == 0) {
+        source = PX1122R_FIX_FROM_GGA;
+    } else if (memcmp(type, "RMC", 3) == 0) {
+        source = PX1122R_FIX_FROM_RMC;
+    } else if (memcmp(type, "GST", 3) == 0) {
+        source = PX1122R_FIX_FROM_GST;
+    } else if (memcmp(type, "GSA", 3) == 0) {
+        source = PX1122R_FIX_FROM_GSA;
+    } else {
+        return;
+    }
+
+    // GSA has no time, so it belongs to whichever epoch is being collected.
+    if (source != PX1122R_FIX_FROM_GSA && parse_time(&fields[1], &time_ms) && time_ms != decoder->epoch_time_ms) {
+        if (decoder->epoch_time_ms != UINT32_MAX) {
+            publish(decoder);
+            decoder->expected = decoder->fix.sources;
+        }
+
+        start_epoch(decoder, time_ms);
+    }
+
+    bool ok;
+
+    switch (source) {
+        case PX1122R_FIX_FROM_GGA:
+            ok = decode_gga(&decoder->fix, fields, count);
+            break;
+        case PX1122R_FIX_FROM_RMC:
+            ok = decode_rmc(&decoder->fix, fields, count);
+            break;
+        case PX1122R_FIX_FROM_GST:
+            ok = decode_gst(&decoder->fix, fields, count);
+            break;
+        default:
+            ok = decode_gsa(&decoder->fix, fields, count);
+            break;
+    }
+
+    if (!ok) {
+        decoder->field_errors++;
+        return;
+    }
+
+    decoder->fix.sources |= source;
+
+    // Don't make everyone wait for the next epoch to start if we already have everything this one is going to get.
+    if (decoder->expected != 0 && (decoder->fix.sources & decoder->expected) == decoder->expected) {
+        publish(decoder);
+    }
+}
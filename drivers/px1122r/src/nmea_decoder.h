@@ -0,0 +1,36 @@
+#ifndef _NMEA_DECODER_H_
+#define _NMEA_DECODER_H_
+
+#include "px1122r.h"
+
+#include <zephyr/types.h>
+#include <stdbool.h>
+
+// Called with each epoch's fix once it's complete. fix is only valid for the duration of the call.
+typedef void (* nmea_fix_cb_t)(const struct px1122r_fix_t* fix, void* user_data);
+
+// Pulls the fields we care about out of GGA, RMC, GST and GSA sentences and collects them into one fix per epoch,
+// all in integer arithmetic. An epoch is complete once it has every sentence type the previous epoch had, or failing
+// that when a sentence from the next epoch turns up.
+struct nmea_decoder_t {
+    struct px1122r_fix_t fix;
+    // UTC time of the epoch being collected.
+    uint32_t epoch_time_ms;
+    bool published;
+    // The sentence types the last complete epoch had.
+    uint8_t expected;
+    nmea_fix_cb_t callback;
+    void* user_data;
+
+    uint32_t epochs;
+    uint32_t field_errors;
+};
+
+void nmea_decoder_init(struct nmea_decoder_t* decoder, nmea_fix_cb_t callback, void* user_data);
+
+void nmea_decoder_reset(struct nmea_decoder_t* decoder);
+
+// Takes a whole sentence, "$" to "\r\n", that has already passed its checksum. Other sentence types are ignored.
+void nmea_decoder_feed(struct nmea_decoder_t* decoder, const uint8_t* sentence, uint16_t len);
+
+#endif
@@ -0,0 +1,117 @@
+#include "nmea_framer.h"
+#include "xor_checksum.h"
+
+#include <zephyr/sys/util.h>
+#include <string.h>
+
+static int8_t hex_value(uint8_t c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+
+    c |= 0x20;
+
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+
+    return -1;
+}
+
+// Checks "$<body>*hh\r\n" and hands it on if it's good.
+static void emit_sentence(struct nmea_framer_t* framer, const uint8_t* sentence, uint16_t len) {
+    // Shortest useful sentence is "$ttsss*hh\r\n".
+    if (len < 11 || sentence[len - 2] != '\r' || sentence[len - 5] != '*') {
+        framer->framing_errors++;
+        return;
+    }
+
+    int8_t hi = hex_value(sentence[len - 4]);
+    int8_t lo = hex_value(sentence[len - 3]);
+
+    if (hi < 0 || lo < 0) {
+        framer->framing_errors++;
+        return;
+    }
+
+    if (xor_checksum(&sentence[1], len - 6) != (uint8_t)((hi << 4) | lo)) {
+        framer->checksum_errors++;
+        return;
+    }
+
+    framer->sentences++;
+
+    if (framer->callback != NULL) {
+        framer->callback(sentence, len, framer->user_data);
+    }
+}
+
+void nmea_framer_init(struct nmea_framer_t* framer, nmea_sentence_cb_t callback, void* user_data) {
+    memset(framer, 0, offsetof(struct nmea_framer_t, scratch));
+    framer->callback = callback;
+    framer->user_data = user_data;
+}
+
+void nmea_framer_reset(struct nmea_framer_t* framer) {
+    framer->in_sentence = false;
+    framer->stitched = 0;
+}
+
+size_t nmea_framer_feed(struct nmea_framer_t* framer, const uint8_t* buf, size_t len) {
+    const uint8_t* start = buf;
+    const uint8_t* end = buf + len;
+
+    if (!framer->in_sentence) {
+        start = memchr(buf, '$', len);
+
+        if (start == NULL) {
+            return len;
+        }
+
+        framer->in_sentence = true;
+        framer->stitched = 0;
+    }
+
+    // The body of the sentence is everything after the "$" that we haven't looked at yet.
+    const uint8_t* body = framer->stitched == 0 ? start + 1 : start;
+    const uint8_t* current = body;
+    const uint8_t* limit = MIN(end, start + NMEA_MAX_SENTENCE_LEN - framer->stitched);
+
+    while (current < limit && *current != '\n' && *current != '$' && *current < 0x80) {
+        ++current;
+    }
+
+    if (current < end && (*current == '$' || *current >= 0x80)) {
+        // Something cut the sentence short and a new sentence or a binary frame has started. Leave that byte for the
+        // next call.
+        framer->framing_errors++;
+        nmea_framer_reset(framer);
+        return current - buf;
+    }
+
+    if (current == limit && limit != end) {
+        framer->framing_errors++;
+        nmea_framer_reset(framer);
+        return current - buf;
+    }
+
+    if (current == end) {
+        // Ran out of data part way through. Keep what we have so far and wait for more.
+        memcpy(&framer->scratch[framer->stitched], start, end - start);
+        framer->stitched += end - start;
+        return len;
+    }
+
+    ++current;
+
+    if (framer->stitched == 0) {
+        emit_sentence(framer, start, current - start);
+    } else {
+        memcpy(&framer->scratch[framer->stitched], start, current - start);
+        emit_sentence(framer, framer->scratch, framer->stitched + (current - start));
+    }
+
+    nmea_framer_reset(framer);
+
+    return current - buf;
+}
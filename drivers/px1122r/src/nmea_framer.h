@@ -0,0 +1,45 @@
+#ifndef _NMEA_FRAMER_H_
+#define _NMEA_FRAMER_H_
+
+#include <zephyr/types.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Longest sentence we'll frame, including the "$" and "\r\n". NMEA 0183 says 82, but proprietary sentences can run
+// a bit longer.
+#define NMEA_MAX_SENTENCE_LEN 128
+
+// Called for every sentence that ends in "*hh\r\n" with a matching checksum. buf points at the "$" and is only valid
+// for the duration of the call.
+typedef void (* nmea_sentence_cb_t)(const uint8_t* buf, uint16_t len, void* user_data);
+
+// Finds "$...*hh\r\n" sentences in a byte stream. Sentences that lie entirely inside one fed span are passed on as a
+// pointer into that span without copying. Only a sentence that straddles two spans is stitched together in the
+// scratch buffer.
+struct nmea_framer_t {
+    bool in_sentence;
+    // Bytes of the current sentence already held in scratch from earlier spans.
+    uint16_t stitched;
+    nmea_sentence_cb_t callback;
+    void* user_data;
+
+    uint32_t sentences;
+    uint32_t checksum_errors;
+    uint32_t framing_errors;
+
+    uint8_t scratch[NMEA_MAX_SENTENCE_LEN];
+};
+
+void nmea_framer_init(struct nmea_framer_t* framer, nmea_sentence_cb_t callback, void* user_data);
+
+void nmea_framer_reset(struct nmea_framer_t* framer);
+
+// Consumes bytes up to and including the end of the next sentence, or up to the start of whatever cut the current
+// sentence short, and returns how many were consumed. Bytes before a "$" are skipped.
+size_t nmea_framer_feed(struct nmea_framer_t* framer, const uint8_t* buf, size_t len);
+
+static inline bool nmea_framer_is_idle(const struct nmea_framer_t* framer) {
+    return !framer->in_sentence;
+}
+
+#endif
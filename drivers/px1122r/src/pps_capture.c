@@ -0,0 +1,144 @@
+#include "pps_capture.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#define PPS_NODE DT_INST(0, skytraq_px1122r)
+
+#if defined(CONFIG_PX1122R_PPS_HW_TIMESTAMP) && DT_NODE_HAS_PROP(PPS_NODE, onepps_gpios)
+#define PPS_HW_TIMESTAMP 1
+#include <nrfx_gpiote.h>
+#include <nrfx_timer.h>
+#include <helpers/nrfx_gppi.h>
+
+// 62.5 ns per tick.
+#define PPS_TIMER_FREQ_MHZ 16
+
+static const nrfx_timer_t pps_timer = NRFX_TIMER_INSTANCE(3);
+#endif
+
+LOG_MODULE_DECLARE(PX1122R, CONFIG_PX1122R_LOG_LEVEL);
+
+static void pps_isr(const struct device* port, struct gpio_callback* cb, gpio_port_pins_t pins) {
+    ARG_UNUSED(port);
+    ARG_UNUSED(pins);
+
+    struct pps_capture_t* pps = CONTAINER_OF(cb, struct pps_capture_t, callback);
+    uint32_t offset_ns = 0;
+
+    uint32_t cycles;
+
+#ifdef PPS_HW_TIMESTAMP
+    if (pps->hw_timestamps) {
+        // CC0 was latched by the edge itself. Latching CC1 right next to reading the cycle counter tells us how long
+        // ago that was.
+        uint32_t now = nrfx_timer_capture(&pps_timer, NRF_TIMER_CC_CHANNEL1);
+        cycles = k_cycle_get_32();
+        uint32_t edge = nrfx_timer_capture_get(&pps_timer, NRF_TIMER_CC_CHANNEL0);
+
+        offset_ns = (now - edge) * 1000 / PPS_TIMER_FREQ_MHZ;
+    } else {
+        cycles = k_cycle_get_32();
+    }
+#else
+    cycles = k_cycle_get_32();
+#endif
+
+    k_spinlock_key_t key = k_spin_lock(&pps->lock);
+    uint8_t next = pps->latest ^ 1;
+
+    pps->edges[next].cycles = cycles;
+    pps->edges[next].offset_ns = offset_ns;
+    pps->edges[next].sequence = pps->edges[pps->latest].sequence + 1;
+    pps->latest = next;
+    k_spin_unlock(&pps->lock, key);
+}
+
+#ifdef PPS_HW_TIMESTAMP
+static void pps_timer_handler(nrf_timer_event_t event_type, void* context) {
+    ARG_UNUSED(event_type);
+    ARG_UNUSED(context);
+}
+
+static int pps_hw_init(void) {
+    nrfx_timer_config_t cfg = NRFX_TIMER_DEFAULT_CONFIG;
+    uint8_t ppi_channel;
+
+    cfg.frequency = NRF_TIMER_FREQ_16MHz;
+    cfg.bit_width = NRF_TIMER_BIT_WIDTH_32;
+
+    if (nrfx_timer_init(&pps_timer, &cfg, pps_timer_handler) != NRFX_SUCCESS) {
+        return -EBUSY;
+    }
+
+    if (nrfx_gppi_channel_alloc(&ppi_channel) != NRFX_SUCCESS) {
+        nrfx_timer_uninit(&pps_timer);
+        return -ENOMEM;
+    }
+
+    // The GPIO driver has already given the pin a GPIOTE channel for its interrupt, so the same IN event drives the
+    // capture.
+    nrfx_gppi_channel_endpoints_setup(ppi_channel,
+                                      nrfx_gpiote_in_event_addr_get(NRF_DT_GPIOS_TO_PSEL(PPS_NODE, onepps_gpios)),
+                                      nrfx_timer_task_address_get(&pps_timer, NRF_TIMER_TASK_CAPTURE0));
+    nrfx_gppi_channels_enable(BIT(ppi_channel));
+    nrfx_timer_enable(&pps_timer);
+
+    return 0;
+}
+#endif
+
+int pps_capture_init(struct pps_capture_t* pps, const struct gpio_dt_spec* gpio) {
+    *pps = (struct pps_capture_t){0};
+
+    if (!gpio_is_ready_dt(gpio)) {
+        return -ENODEV;
+    }
+
+    int err = gpio_pin_configure_dt(gpio, GPIO_INPUT);
+    if (err != 0) {
+        return err;
+    }
+
+    gpio_init_callback(&pps->callback, pps_isr, BIT(gpio->pin));
+
+    err = gpio_add_callback(gpio->port, &pps->callback);
+    if (err != 0) {
+        return err;
+    }
+
+    err = gpio_pin_interrupt_configure_dt(gpio, GPIO_INT_EDGE_TO_ACTIVE);
+    if (err != 0) {
+        return err;
+    }
+
+#ifdef PPS_HW_TIMESTAMP
+    err = pps_hw_init();
+    if (err != 0) {
+        LOG_WRN("No hardware PPS timestamps (err %d), falling back to the ISR", err);
+    } else {
+        pps->hw_timestamps = true;
+    }
+#endif
+
+    return 0;
+}
+
+bool pps_capture_get(struct pps_capture_t* pps, uint32_t cycles, struct px1122r_pps_edge_t* edge) {
+    k_spinlock_key_t key = k_spin_lock(&pps->lock);
+    bool found = false;
+
+    for (int i = 0; i < 2; ++i) {
+        const struct px1122r_pps_edge_t* candidate = &pps->edges[pps->latest ^ i];
+
+        if (candidate->sequence != 0 && (int32_t)(cycles - candidate->cycles) >= 0) {
+            *edge = *candidate;
+            found = true;
+            break;
+        }
+    }
+
+    k_spin_unlock(&pps->lock, key);
+
+    return found;
+}
@@ -0,0 +1,26 @@
+#ifndef _PPS_CAPTURE_H_
+#define _PPS_CAPTURE_H_
+
+#include "px1122r.h"
+
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/spinlock.h>
+
+// Timestamps the receiver's 1PPS edges. With CONFIG_PX1122R_PPS_HW_TIMESTAMP the edge is captured by a 16 MHz timer
+// through PPI, so interrupt latency is measured and reported rather than hidden in the timestamp. Otherwise it's
+// whenever the GPIO ISR runs.
+struct pps_capture_t {
+    struct gpio_callback callback;
+    struct k_spinlock lock;
+    // The last two edges, so a message can be matched with the edge before it even if another has come in since.
+    struct px1122r_pps_edge_t edges[2];
+    uint8_t latest;
+    bool hw_timestamps;
+};
+
+int pps_capture_init(struct pps_capture_t* pps, const struct gpio_dt_spec* gpio);
+
+// Finds the most recent edge at or before cycles. Returns false if there isn't one.
+bool pps_capture_get(struct pps_capture_t* pps, uint32_t cycles, struct px1122r_pps_edge_t* edge);
+
+#endif
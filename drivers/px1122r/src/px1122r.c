@@ -1,4 +1,10 @@
 #include "px1122r.h"
+#include "skytraq_parser.h"
+#include "nmea_framer.h"
+#include "nmea_decoder.h"
+#include "rtcm3_framer.h"
+#include "xor_checksum.h"
+#include "pps_capture.h"
 
 #include <zephyr/drivers/uart.h>
 #include <zephyr/types.h>
@@ -14,55 +20,137 @@ LOG_MODULE_REGISTER(PX1122R, LOG_LEVEL);
 
 static void uart_cb(const struct device* dev, struct uart_event* evt, void* user_data);
 
-static void work_handler(struct k_work* work);
+static void rx_work_handler(struct k_work* work);
 
-#define NUM_RX_BUFS 2
-#define BUF_SIZE 256
-#define MAX_PAYLOAD_SIZE 128
+static void handle_skytraq_message(const uint8_t* payload, uint16_t len, void* user_data);
+
+static void handle_nmea_sentence(const uint8_t* buf, uint16_t len, void* user_data);
+
+static void handle_nmea_fix(const struct px1122r_fix_t* fix, void* user_data);
+
+static void handle_rtcm3_frame(const uint8_t* buf, uint16_t len, uint16_t msg_type, void* user_data);
+
+static void cmd_work_handler(struct k_work* work);
+
+static void cmd_timeout_handler(struct k_work* work);
+
+static void corrections_uart_cb(const struct device* dev, struct uart_event* evt, void* user_data);
+
+static void corrections_work_handler(struct k_work* work);
+
+#define NUM_RX_BUFS CONFIG_PX1122R_RX_BUF_COUNT
+#define RX_BUF_SIZE CONFIG_PX1122R_RX_BUF_SIZE
+#define RX_QUEUE_SIZE CONFIG_PX1122R_RX_QUEUE_SIZE
+
+BUILD_ASSERT(RX_QUEUE_SIZE > NUM_RX_BUFS, "The RX queue needs an entry per RX buffer and more");
 #define RX_BUF_TIMEOUT_US 250
+#define CMD_QUEUE_SIZE CONFIG_PX1122R_CMD_QUEUE_SIZE
+#define CORRECTIONS_QUEUE_SIZE CONFIG_PX1122R_CORRECTIONS_QUEUE_SIZE
+// Preamble, length, checksum and postamble around the payload.
+#define CMD_FRAME_OVERHEAD 7
+#define CMD_FRAME_SIZE (CONFIG_PX1122R_MAX_COMMAND_SIZE + CMD_FRAME_OVERHEAD)
+
+BUILD_ASSERT(NUM_RX_BUFS < 32, "The free buffer bitmap is a single atomic_t");
+
+// A chunk of received data, or a marker saying the UART has finished with a buffer when len is 0.
+// Both go through the same queue so a buffer is never handed back to the UART before its data has been consumed.
+struct rx_chunk_t {
+    uint8_t slot;
+    uint16_t offset;
+    uint16_t len;
+    uint32_t timestamp;
+};
+
+// Where the worker is with logging the receive rate after a baud rate change.
+enum rate_report_t {
+    RATE_REPORT_NONE,
+    // The next run starts a fresh window,
+    RATE_REPORT_RESTART,
+    // and logs the rate once it's complete.
+    RATE_REPORT_PENDING
+};
+
+// A command waiting to go out, already framed. Every command in a batch carries the batch's callback and knows how
+// many commands follow it, so a failure part way through can skip the rest.
+struct cmd_entry_t {
+    uint8_t frame[CMD_FRAME_SIZE];
+    // Either frame, or a prebuilt frame handed to us by the caller.
+    const uint8_t* tx;
+    uint16_t frame_len;
+    uint16_t settle_ms;
+    uint8_t batch_remaining;
+    px1122r_command_cb_t callback;
+    void* user_data;
+};
+
+struct corrections_item_t {
+    struct net_buf* buf;
+    px1122r_release_cb_t release;
+};
 
 struct px1122r_dev_data {
+    const struct device* dev;
     const struct device* uart_dev;
     const struct device* uart_dev2;
-    uint8_t cur_buf;
-    uint8_t rx_bufs[NUM_RX_BUFS][BUF_SIZE];
-    uint8_t tx_buf[BUF_SIZE];
+    uint8_t rx_bufs[NUM_RX_BUFS][RX_BUF_SIZE];
+    // Bit n is set when rx_bufs[n] is neither owned by the UART nor holding unconsumed data.
+    atomic_t rx_free;
+    // Buffers the UART released while the queue was full. They're freed when the worker finds the queue empty.
+    atomic_t rx_orphaned;
+    uint8_t next_slot;
+    // RX should be running. If the UART stops on its own while this is set we restart it from the worker.
+    bool rx_wanted;
+    bool rx_stalled;
+    // Chunks waiting for the worker. The UART callback grows the last one in place once this is nearly full, so it's a
+    // ring of our own rather than a k_msgq.
+    struct rx_chunk_t rx_chunks[RX_QUEUE_SIZE];
+    uint8_t rx_head;
+    uint8_t rx_count;
+    struct k_spinlock rx_lock;
+    struct k_work rx_work;
+    struct px1122r_stats_t stats;
+    int64_t rate_window_start;
+    uint32_t rate_window_bytes;
+    // Set after a baud rate change, so the worker logs what the first full window at the new rate actually carried.
+    atomic_t rate_report;
+    struct skytraq_parser_t parser;
+    struct nmea_framer_t nmea_framer;
+    struct nmea_decoder_t nmea_decoder;
+    struct rtcm3_framer_t rtcm3_framer;
     bool stream_mode;
     px1122r_callback_t callback;
-    int8_t command_response;
+    // When the chunk being parsed arrived, and the PPS edge before that. Anything completed while parsing it gets
+    // these.
+    uint32_t rx_timestamp;
+    struct px1122r_pps_edge_t rx_pps;
+    struct gpio_dt_spec onepps;
+    struct pps_capture_t pps;
+    bool has_pps;
+    // Commands are queued by any thread, but only ever sent and completed from the driver's work queue.
+    struct cmd_entry_t cmd_queue[CMD_QUEUE_SIZE];
+    uint8_t cmd_head;
+    uint8_t cmd_count;
+    bool cmd_in_flight;
+    struct k_spinlock cmd_lock;
+    struct k_work_delayable cmd_work;
+    struct k_work_delayable cmd_timeout;
+    // Correction frames waiting for the second UART, the one going out, and the buffer in its chain the UART has now.
+    struct k_msgq corrections_queue;
+    char corrections_queue_buf[CORRECTIONS_QUEUE_SIZE * sizeof(struct corrections_item_t)];
+    struct corrections_item_t corrections_frame;
+    struct net_buf* corrections_frag;
+    atomic_t corrections_busy;
+    int corrections_result;
+    struct k_work corrections_work;
 };
 
 #define WORKER_STACK_SIZE 512
 #define WORKER_PRIORITY 5
 
 K_THREAD_STACK_DEFINE(worker_stack_area, WORKER_STACK_SIZE);
-static K_SEM_DEFINE(command_sem, 0, 1);
 
 struct k_work_q work_queue;
 
-struct work_item_t {
-    struct k_work work;
-    struct px1122r_dev_data* dev_data;
-    uint8_t* buf;
-    uint16_t len;
-} work_item;
-
-struct skytraq_message_t {
-    uint16_t payload_length;
-    uint8_t message_type;
-    uint8_t payload[0];
-};
-
-static uint8_t calc_checksum(const uint8_t* msg, uint16_t length) {
-    uint8_t cs = 0;
-
-    for (uint16_t i = 0; i < length; ++i) {
-        cs ^= *msg++;
-    }
-
-    return cs;
-}
-
 static int px1122r_init(const struct device* dev) {
     struct px1122r_dev_data* data = dev->data;
 
@@ -71,8 +159,21 @@ static int px1122r_init(const struct device* dev) {
         return -ENODEV;
     }
 
+    atomic_set(&data->rx_free, BIT_MASK(NUM_RX_BUFS));
+    atomic_clear(&data->rx_orphaned);
+    k_work_init(&data->rx_work, rx_work_handler);
+    data->dev = dev;
+    k_work_init_delayable(&data->cmd_work, cmd_work_handler);
+    k_work_init_delayable(&data->cmd_timeout, cmd_timeout_handler);
+    k_msgq_init(&data->corrections_queue, data->corrections_queue_buf, sizeof(struct corrections_item_t),
+                CORRECTIONS_QUEUE_SIZE);
+    k_work_init(&data->corrections_work, corrections_work_handler);
+    skytraq_parser_init(&data->parser, handle_skytraq_message, data);
+    nmea_framer_init(&data->nmea_framer, handle_nmea_sentence, data);
+    nmea_decoder_init(&data->nmea_decoder, handle_nmea_fix, data);
+    rtcm3_framer_init(&data->rtcm3_framer, handle_rtcm3_frame, data);
+
     k_work_queue_init(&work_queue);
-    k_work_init(&work_item.work, work_handler);
     k_work_queue_start(&work_queue, worker_stack_area,
                        K_THREAD_STACK_SIZEOF(worker_stack_area), WORKER_PRIORITY,
                        NULL);
@@ -85,159 +186,423 @@ static int px1122r_init(const struct device* dev) {
         return -EINVAL;
     }
 
+    // The second UART only goes one way, to the receiver's RTCM input.
+    err = uart_callback_set(data->uart_dev2, corrections_uart_cb, (void*)dev);
+
+    if (err != 0) {
+        LOG_ERR("Failed to init corrections UART callback");
+        return -EINVAL;
+    }
+
+    if (data->onepps.port != NULL) {
+        err = pps_capture_init(&data->pps, &data->onepps);
+
+        if (err != 0) {
+            LOG_WRN("Failed to set up the 1PPS input (err %d)", err);
+        } else {
+            data->has_pps = true;
+        }
+    }
+
     LOG_DBG("PX1122R initialized");
 
     return 0;
 }
 
-static int8_t display_skytraq_message(const uint8_t* buffer) {
-    const struct skytraq_message_t* message = (const struct skytraq_message_t*)buffer;
+static void cmd_complete(struct px1122r_dev_data* data, int result);
+
+static void handle_skytraq_message(const uint8_t* payload, uint16_t len, void* user_data) {
+    struct px1122r_dev_data* data = user_data;
 
-    switch (message->message_type) {
+    switch (payload[0]) {
         case 0x83:
-            LOG_DBG("ACK 0x%02x", message->payload[0]);
-            return 1;
+        case 0x84: {
+            if (!data->cmd_in_flight) {
+                LOG_WRN("Unexpected %s 0x%02x", payload[0] == 0x83 ? "ACK" : "NACK", len > 1 ? payload[1] : 0);
+                break;
+            }
 
-        case 0x84:
-            LOG_DBG("NACK 0x%02x", message->payload[0]);
-            return 0;
+            // The response echoes the message ID, and the sub-ID for commands that have one.
+            const struct cmd_entry_t* entry = &data->cmd_queue[data->cmd_head];
+            uint16_t id_len = MIN(len - 1, 2);
 
-        default:
-            LOG_WRN("Unknown response 0x%02x", message->message_type);
-//            LOG_HEXDUMP_DBG(message->payload, sys_be16_to_cpu(message->payload_length) - 1, "Payload");
-            return -1;
-    }
-}
-
-static bool handle_skytraq_message(uint8_t* buf, uint8_t buf_len, struct px1122r_dev_data* data) {
-    static int state = 0;
-    static uint16_t payload_len = 0;
-    static uint16_t payload_counter = 0;
-    static uint8_t checksum = 0;
-    static uint8_t payload_buf[MAX_PAYLOAD_SIZE];
-    uint8_t* current = buf;
-    uint8_t* current_payload = payload_buf;
-    bool ret = false;
-
-    for (uint32_t i = 0; i < buf_len; ++i, current++) {
-        switch (state) {
-            case 0:
-                checksum = 0;
-                payload_len = 0;
-                payload_counter = 0;
-                current_payload = payload_buf;
-                ret = false;
-                if (*current == 0xa0) {
-                    state = 1;
-                }
+            if (id_len == 0 || memcmp(&payload[1], &entry->tx[4], id_len) != 0) {
+                LOG_WRN("Response for 0x%02x while waiting for 0x%02x", len > 1 ? payload[1] : 0, entry->tx[4]);
                 break;
-            case 1:
-                if (*current == 0xa1) {
-                    state = 2;
-                } else {
-                    state = 0;
-                }
-                break;
-            case 2:
-                payload_len = *current << 8;
-                *(current_payload++) = *current;
-                state = 3;
-                break;
-            case 3:
-                payload_len |= *current;
-                if (payload_len > MAX_PAYLOAD_SIZE) {
-                    LOG_WRN("Payload size too big for buffer %d. Skipping packet.", payload_len);
-                    state = 0;
-                    break;
-                }
-                *(current_payload++) = *current;
-                payload_counter = payload_len;
-                state = 4;
-                break;
-            case 4:
-                --payload_counter;
-                checksum ^= *current;
-                *(current_payload++) = *current;
-
-                if (payload_counter == 0) {
-                    state = 5;
-                }
-                break;
-            case 5:
-                if (checksum != *current) {
-                    LOG_WRN("Checksum mismatch calc %x got %x", checksum, *current);
-                }
-                state = 6;
+            }
+
+            LOG_DBG("%s 0x%02x", payload[0] == 0x83 ? "ACK" : "NACK", payload[1]);
+            cmd_complete(data, payload[0] == 0x83 ? 0 : -EBADMSG);
+            break;
+        }
+
+        case 0x80:
+            if (len >= 14) {
+                LOG_INF("Receiver kernel %06x ODM %06x revision %06x", sys_get_be24(&payload[2]),
+                        sys_get_be24(&payload[6]), sys_get_be24(&payload[10]));
+            }
+            break;
+
+        case PX1122R_MSG_ID_NAV_DATA: {
+            struct px1122r_fix_t fix;
+
+            if (!data->stream_mode || data->callback == NULL) {
                 break;
-            case 6:
-                // Postamble 1
-                state = 7;
+            }
+
+            if (px1122r_decode_nav_data(payload, len, &fix) != 0) {
+                LOG_WRN("Short navigation data message (%u bytes)", len);
                 break;
-            case 7:
-                // Postamble 2
-                state = 0;
-                ret = true;
-                data->command_response = display_skytraq_message(payload_buf);
-                k_sem_give(&command_sem);
+            }
+
+            struct px1122r_msg_t msg = {
+                .type = PX1122R_MSG_FIX,
+                .timestamp = data->rx_timestamp,
+                .pps = data->rx_pps,
+                .buf = (const uint8_t*)&fix,
+                .len = sizeof(fix),
+            };
+
+            data->callback(&msg);
+            break;
+        }
+
+        case PX1122R_MSG_ID_MEAS_TIME:
+        case PX1122R_MSG_ID_RAW_MEAS:
+        case PX1122R_MSG_ID_SV_CH_STATUS:
+        case PX1122R_MSG_ID_RCV_STATE: {
+            if (!data->stream_mode || data->callback == NULL) {
                 break;
+            }
+
+            // Raw measurements are passed through as is, they're already compact and the consumer decides what to keep.
+            struct px1122r_msg_t msg = {
+                .type = PX1122R_MSG_SKYTRAQ,
+                .timestamp = data->rx_timestamp,
+                .pps = data->rx_pps,
+                .buf = payload,
+                .len = len,
+                .skytraq.msg_id = payload[0],
+            };
+
+            data->callback(&msg);
+            break;
+        }
+
+        default:
+            LOG_WRN("Unknown response 0x%02x", payload[0]);
+//            LOG_HEXDUMP_DBG(payload, len, "Payload");
+            break;
+    }
+}
+
+static void handle_nmea_sentence(const uint8_t* buf, uint16_t len, void* user_data) {
+    struct px1122r_dev_data* data = user_data;
+
+    if (!data->stream_mode || data->callback == NULL) {
+        return;
+    }
+
+    struct px1122r_msg_t msg = {
+        .type = PX1122R_MSG_NMEA,
+        .timestamp = data->rx_timestamp,
+        .pps = data->rx_pps,
+        .buf = buf,
+        .len = len,
+    };
+
+    if (buf[1] == 'P') {
+        msg.nmea.talker[0] = 'P';
+        msg.nmea.talker[1] = '\0';
+        memcpy(msg.nmea.sentence, &buf[2], sizeof(msg.nmea.sentence));
+    } else {
+        memcpy(msg.nmea.talker, &buf[1], sizeof(msg.nmea.talker));
+        memcpy(msg.nmea.sentence, &buf[3], sizeof(msg.nmea.sentence));
+    }
+
+    data->callback(&msg);
+
+    // After the sentence itself, so a fix never reaches anyone ahead of the sentence that completed it.
+    nmea_decoder_feed(&data->nmea_decoder, buf, len);
+}
+
+static void handle_nmea_fix(const struct px1122r_fix_t* fix, void* user_data) {
+    struct px1122r_dev_data* data = user_data;
+
+    struct px1122r_msg_t msg = {
+        .type = PX1122R_MSG_FIX,
+        .timestamp = data->rx_timestamp,
+        .pps = data->rx_pps,
+        .buf = (const uint8_t*)fix,
+        .len = sizeof(*fix),
+    };
+
+    data->callback(&msg);
+}
+
+static void handle_rtcm3_frame(const uint8_t* buf, uint16_t len, uint16_t msg_type, void* user_data) {
+    struct px1122r_dev_data* data = user_data;
+
+    if (!data->stream_mode || data->callback == NULL) {
+        return;
+    }
+
+    struct px1122r_msg_t msg = {
+        .type = PX1122R_MSG_RTCM3,
+        .timestamp = data->rx_timestamp,
+        .pps = data->rx_pps,
+        .buf = buf,
+        .len = len,
+        .rtcm3.msg_type = msg_type,
+    };
+
+    data->callback(&msg);
+}
+
+// Passes the stream to whichever parser is part way through a message. When none is, it skips to the next byte that
+// can start a message and hands over from there. This is how command responses are picked out of a live NMEA/RTCM
+// stream. SkyTraq binary always starts with 0xa0, RTCM with 0xd3 and NMEA with "$", but start bytes are only looked
+// for between messages. RTCM and SkyTraq payloads can hold any of them and the framers take those as payload, going by
+// the length in the header. Only the NMEA framer, which never sees anything but ASCII, stops at one and hands it back.
+static size_t demux_stream(struct px1122r_dev_data* data, const uint8_t* buf, size_t len) {
+    if (!nmea_framer_is_idle(&data->nmea_framer)) {
+        return nmea_framer_feed(&data->nmea_framer, buf, len);
+    }
+
+    if (!rtcm3_framer_is_idle(&data->rtcm3_framer)) {
+        return rtcm3_framer_feed(&data->rtcm3_framer, buf, len);
+    }
+
+    if (!skytraq_parser_is_idle(&data->parser)) {
+        return skytraq_parser_feed(&data->parser, buf, len);
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        switch (buf[i]) {
+            case '$':
+                return i + nmea_framer_feed(&data->nmea_framer, &buf[i], len - i);
+
+            case RTCM3_PREAMBLE:
+                return i + rtcm3_framer_feed(&data->rtcm3_framer, &buf[i], len - i);
+
+            case SKYTRAQ_SYNC_1:
+                return i + skytraq_parser_feed(&data->parser, &buf[i], len - i);
+
             default:
-                LOG_WRN("Unknown state %d", state);
                 break;
         }
     }
 
-    return ret;
+    return len;
 }
 
-static void work_handler(struct k_work* work) {
-    struct work_item_t* my_work = (struct work_item_t*) work;
-    struct px1122r_dev_data* data = my_work->dev_data;
-    static int state = 0;
+static void handle_rx_data(struct px1122r_dev_data* data, uint8_t* buf, uint16_t len) {
+    while (len > 0) {
+        size_t consumed = demux_stream(data, buf, len);
+        buf += consumed;
+        len -= consumed;
+    }
+}
 
-    if (data->stream_mode) {
-        if (data->callback != NULL) {
-            data->callback(my_work->buf, my_work->len);
+// Hands out the free buffer after the one we gave the UART last, so buffers are used round-robin.
+static int rx_slot_alloc(struct px1122r_dev_data* data) {
+    for (uint8_t i = 0; i < NUM_RX_BUFS; ++i) {
+        uint8_t slot = (data->next_slot + i) % NUM_RX_BUFS;
+
+        if (atomic_test_and_clear_bit(&data->rx_free, slot)) {
+            data->next_slot = (slot + 1) % NUM_RX_BUFS;
+            return slot;
         }
+    }
+
+    return -ENOMEM;
+}
+
+static int rx_start(struct px1122r_dev_data* data) {
+    int slot = rx_slot_alloc(data);
+
+    if (slot < 0) {
+        return slot;
+    }
+
+    // Whatever the parsers were part way through is gone.
+    skytraq_parser_reset(&data->parser);
+    nmea_framer_reset(&data->nmea_framer);
+    nmea_decoder_reset(&data->nmea_decoder);
+    rtcm3_framer_reset(&data->rtcm3_framer);
+
+    data->rx_wanted = true;
+    data->rx_stalled = false;
+
+    int err = uart_rx_enable(data->uart_dev, data->rx_bufs[slot], RX_BUF_SIZE, RX_BUF_TIMEOUT_US);
+    if (err != 0) {
+        data->rx_wanted = false;
+        atomic_set_bit(&data->rx_free, slot);
+    }
+
+    return err;
+}
+
+static void rx_stop(struct px1122r_dev_data* data) {
+    data->rx_wanted = false;
+    uart_rx_disable(data->uart_dev);
+}
+
+// RX runs while we're streaming or talking to the receiver. Only called from the driver's work queue.
+static void rx_update(struct px1122r_dev_data* data) {
+    bool needed = data->stream_mode || data->cmd_count > 0 || data->cmd_in_flight;
+
+    if (needed && !data->rx_wanted) {
+        rx_start(data);
+    } else if (!needed && data->rx_wanted) {
+        rx_stop(data);
+    }
+}
+
+static bool rx_queue_get(struct px1122r_dev_data* data, struct rx_chunk_t* chunk) {
+    k_spinlock_key_t key = k_spin_lock(&data->rx_lock);
+    bool got = data->rx_count > 0;
+
+    if (got) {
+        *chunk = data->rx_chunks[data->rx_head];
+        data->rx_head = (data->rx_head + 1) % RX_QUEUE_SIZE;
+        data->rx_count--;
     } else {
-        if (state == 0) {
-            for (int i = 0; i < my_work->len; ++i) {
-                if (my_work->buf[i] == 0xa0) {
-                    if (!handle_skytraq_message(&my_work->buf[i], my_work->len - i, data)) {
-                        state = 1;
-                    }
-                    break;
-                }
-            }
+        // Anything orphaned had its data queued ahead of the release, and the worker only asks again once it's done
+        // with the last chunk, so an empty queue means it has all been consumed. This has to be under the lock, or the
+        // UART could fill the queue and orphan a buffer whose data is still in it.
+        atomic_or(&data->rx_free, atomic_clear(&data->rx_orphaned));
+    }
+
+    k_spin_unlock(&data->rx_lock, key);
+
+    return got;
+}
+
+static void rx_work_handler(struct k_work* work) {
+    struct px1122r_dev_data* data = CONTAINER_OF(work, struct px1122r_dev_data, rx_work);
+    struct rx_chunk_t chunk;
+
+    while (rx_queue_get(data, &chunk)) {
+        if (chunk.len == 0) {
+            atomic_set_bit(&data->rx_free, chunk.slot);
         } else {
-            if (handle_skytraq_message(&my_work->buf[0], my_work->len, data)) {
-                // TODO: We might have data left in the buffer. Do something with it.
-                // I think it's only a problem if a message ends at the end of the buffer.
-                state = 0;
+            data->rx_timestamp = chunk.timestamp;
+
+            if (!data->has_pps || !pps_capture_get(&data->pps, chunk.timestamp, &data->rx_pps)) {
+                data->rx_pps = (struct px1122r_pps_edge_t){0};
             }
+
+            handle_rx_data(data, &data->rx_bufs[chunk.slot][chunk.offset], chunk.len);
+        }
+    }
+
+    int64_t now = k_uptime_get();
+    int64_t elapsed = now - data->rate_window_start;
+
+    // The window that's running when the rate changes is partly at the old one, so it starts again.
+    if (atomic_cas(&data->rate_report, RATE_REPORT_RESTART, RATE_REPORT_PENDING)) {
+        data->rate_window_bytes = data->stats.rx_bytes;
+        data->rate_window_start = now;
+    } else if (elapsed >= 1000) {
+        data->stats.rx_bytes_per_sec = (uint32_t)((data->stats.rx_bytes - data->rate_window_bytes) * 1000LL / elapsed);
+        data->rate_window_bytes = data->stats.rx_bytes;
+        data->rate_window_start = now;
+
+        if (atomic_cas(&data->rate_report, RATE_REPORT_PENDING, RATE_REPORT_NONE)) {
+            LOG_INF("Receiving %u bytes/s at %u baud, %u%% of what the line carries", data->stats.rx_bytes_per_sec,
+                    data->stats.baudrate, data->stats.rx_bytes_per_sec * 10 / (data->stats.baudrate / 100));
+        }
+    }
+
+    if (data->rx_wanted && data->rx_stalled) {
+        if (rx_start(data) == 0) {
+            LOG_WRN("RX restarted after running out of buffers");
         }
     }
+
+    rx_update(data);
+}
+
+// The idle timeout makes UART_RX_RDY far more common than full buffers, so once the queue is nearly full a chunk that
+// carries on from the last one is added to it instead. The last NUM_RX_BUFS entries are kept for the first chunk of
+// each buffer: a buffer can't be reused until the worker has consumed it, so there can't be more of those waiting than
+// there are buffers, and data is only ever dropped when every buffer is full. Releases that don't fit are orphaned.
+static void rx_queue_put(struct px1122r_dev_data* data, const struct rx_chunk_t* chunk) {
+    k_spinlock_key_t key = k_spin_lock(&data->rx_lock);
+    struct rx_chunk_t* tail = data->rx_count > 0 ?
+            &data->rx_chunks[(data->rx_head + data->rx_count - 1) % RX_QUEUE_SIZE] : NULL;
+    bool reserve = data->rx_count >= RX_QUEUE_SIZE - NUM_RX_BUFS;
+
+    if (reserve && chunk->len != 0 && tail != NULL && tail->len != 0 && tail->slot == chunk->slot &&
+        tail->offset + tail->len == chunk->offset) {
+        tail->len += chunk->len;
+    } else if (chunk->len == 0 && reserve) {
+        atomic_set_bit(&data->rx_orphaned, chunk->slot);
+    } else if (data->rx_count < RX_QUEUE_SIZE) {
+        data->rx_chunks[(data->rx_head + data->rx_count) % RX_QUEUE_SIZE] = *chunk;
+        data->rx_count++;
+
+        if (data->rx_count > data->stats.rx_queue_high_water) {
+            data->stats.rx_queue_high_water = data->rx_count;
+        }
+    } else {
+        data->stats.rx_dropped_chunks++;
+        data->stats.rx_dropped_bytes += chunk->len;
+    }
+
+    k_spin_unlock(&data->rx_lock, key);
+
+    k_work_submit_to_queue(&work_queue, &data->rx_work);
 }
 
 static void uart_cb(const struct device* dev, struct uart_event* evt, void* user_data) {
     const struct device* px1122r_dev = user_data;
     struct px1122r_dev_data* data = px1122r_dev->data;
+    struct rx_chunk_t chunk;
 
     switch (evt->type) {
         case UART_RX_RDY:
-            if (!k_work_is_pending(&work_item.work)) {
-                work_item.dev_data = data;
-                work_item.buf = evt->data.rx.buf + evt->data.rx.offset;
-                LOG_DBG("len %d", evt->data.rx.len);
-                work_item.len = evt->data.rx.len;
-                k_work_submit_to_queue(&work_queue, &work_item.work);
-            } else {
-                LOG_WRN("Work item still pending");
+            chunk.slot = (evt->data.rx.buf - data->rx_bufs[0]) / RX_BUF_SIZE;
+            chunk.offset = evt->data.rx.offset;
+            chunk.len = evt->data.rx.len;
+            chunk.timestamp = k_cycle_get_32();
+            data->stats.rx_bytes += chunk.len;
+            rx_queue_put(data, &chunk);
+            break;
+
+        case UART_RX_BUF_REQUEST: {
+            int slot = rx_slot_alloc(data);
+
+            if (slot < 0) {
+                // Every buffer is waiting to be consumed. The UART stops once the current one is full and the
+                // worker restarts it when a buffer comes back.
+                data->stats.rx_overruns++;
+                break;
             }
+
+            uart_rx_buf_rsp(dev, data->rx_bufs[slot], RX_BUF_SIZE);
             break;
+        }
 
-        case UART_RX_BUF_REQUEST:
-            data->cur_buf = (data->cur_buf + 1) % NUM_RX_BUFS;
-            uart_rx_buf_rsp(dev, data->rx_bufs[data->cur_buf], BUF_SIZE);
+        case UART_RX_BUF_RELEASED:
+            chunk.slot = (evt->data.rx_buf.buf - data->rx_bufs[0]) / RX_BUF_SIZE;
+            chunk.offset = 0;
+            chunk.len = 0;
+            rx_queue_put(data, &chunk);
+            break;
+
+        case UART_RX_STOPPED:
+            data->stats.rx_errors++;
+            break;
+
+        case UART_RX_DISABLED:
+            if (data->rx_wanted) {
+                data->rx_stalled = true;
+            }
+
+            // Also lets the worker restart RX if someone asked for it again while it was shutting down.
+            k_work_submit_to_queue(&work_queue, &data->rx_work);
             break;
 
         default:
@@ -245,64 +610,457 @@ static void uart_cb(const struct device* dev, struct uart_event* evt, void* user
     }
 }
 
+static void cmd_pop(struct px1122r_dev_data* data, uint8_t count) {
+    k_spinlock_key_t key = k_spin_lock(&data->cmd_lock);
+    data->cmd_head = (data->cmd_head + count) % CMD_QUEUE_SIZE;
+    data->cmd_count -= count;
+    k_spin_unlock(&data->cmd_lock, key);
+}
+
+// Finishes the command at the head of the queue. Called from the driver's work queue only.
+static void cmd_complete(struct px1122r_dev_data* data, int result) {
+    struct cmd_entry_t* entry = &data->cmd_queue[data->cmd_head];
+    px1122r_command_cb_t callback = entry->callback;
+    void* user_data = entry->user_data;
+    uint8_t msg_id = entry->tx[4];
+    uint16_t settle_ms = entry->settle_ms;
+    bool notify = result != 0 || entry->batch_remaining == 0;
+
+    k_work_cancel_delayable(&data->cmd_timeout);
+    data->cmd_in_flight = false;
+
+    if (result != 0) {
+        LOG_ERR("Command 0x%02x failed. %d", msg_id, result);
+        // Nothing after a failed command in the same batch gets sent.
+        cmd_pop(data, 1 + entry->batch_remaining);
+    } else {
+        cmd_pop(data, 1);
+    }
+
+    if (notify && callback != NULL) {
+        callback(data->dev, msg_id, result, user_data);
+    }
+
+    // Some commands restart the receiver, and it won't listen for a little while afterwards.
+    k_work_reschedule_for_queue(&work_queue, &data->cmd_work, result == 0 ? K_MSEC(settle_ms) : K_NO_WAIT);
+}
+
+static void cmd_timeout_handler(struct k_work* work) {
+    struct k_work_delayable* dwork = k_work_delayable_from_work(work);
+    struct px1122r_dev_data* data = CONTAINER_OF(dwork, struct px1122r_dev_data, cmd_timeout);
+
+    if (data->cmd_in_flight) {
+        cmd_complete(data, -ETIMEDOUT);
+    }
+}
+
+// Sends the command at the head of the queue when nothing is waiting for a response.
+static void cmd_work_handler(struct k_work* work) {
+    struct k_work_delayable* dwork = k_work_delayable_from_work(work);
+    struct px1122r_dev_data* data = CONTAINER_OF(dwork, struct px1122r_dev_data, cmd_work);
+
+    if (data->cmd_in_flight) {
+        return;
+    }
+
+    rx_update(data);
+
+    if (data->cmd_count == 0) {
+        return;
+    }
+
+    struct cmd_entry_t* entry = &data->cmd_queue[data->cmd_head];
+    data->cmd_in_flight = true;
+
+    int err = uart_tx(data->uart_dev, entry->tx, entry->frame_len, SYS_FOREVER_US);
+    if (err != 0) {
+        cmd_complete(data, err);
+        return;
+    }
+
+    k_work_reschedule_for_queue(&work_queue, &data->cmd_timeout, K_MSEC(CONFIG_PX1122R_CMD_TIMEOUT_MS));
+}
+
+static void cmd_frame(struct cmd_entry_t* entry, const void* command, uint16_t length) {
+    entry->frame[0] = 0xa0;
+    entry->frame[1] = 0xa1;
+    entry->frame[2] = length >> 8;
+    entry->frame[3] = length & 0xff;
+    memcpy(&entry->frame[4], command, length);
+    entry->frame[length + 4] = xor_checksum(command, length);
+    entry->frame[length + 5] = 0x0d;
+    entry->frame[length + 6] = 0x0a;
+    entry->frame_len = length + CMD_FRAME_OVERHEAD;
+    entry->tx = entry->frame;
+}
+
+int px1122r_send_batch(const struct device* dev, const struct px1122r_command_t* commands, size_t count,
+                       px1122r_command_cb_t cb, void* user_data) {
+    struct px1122r_dev_data* data = dev->data;
+
+    if (count == 0 || count > CMD_QUEUE_SIZE) {
+        return -EINVAL;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        if (commands[i].framed) {
+            const uint8_t* frame = commands[i].payload;
+
+            if (commands[i].length <= CMD_FRAME_OVERHEAD || frame[0] != 0xa0 || frame[1] != 0xa1) {
+                return -EINVAL;
+            }
+        } else if (commands[i].length == 0 || commands[i].length > CONFIG_PX1122R_MAX_COMMAND_SIZE) {
+            return -EINVAL;
+        }
+    }
+
+    // The whole batch goes in or none of it does. Framing is a short copy, so it's done under the lock to keep
+    // batches from different threads apart.
+    k_spinlock_key_t key = k_spin_lock(&data->cmd_lock);
+
+    if (data->cmd_count + count > CMD_QUEUE_SIZE) {
+        k_spin_unlock(&data->cmd_lock, key);
+        return -ENOBUFS;
+    }
+
+    uint8_t tail = (data->cmd_head + data->cmd_count) % CMD_QUEUE_SIZE;
+
+    for (size_t i = 0; i < count; ++i) {
+        struct cmd_entry_t* entry = &data->cmd_queue[(tail + i) % CMD_QUEUE_SIZE];
+
+        if (commands[i].framed) {
+            entry->tx = commands[i].payload;
+            entry->frame_len = commands[i].length;
+        } else {
+            cmd_frame(entry, commands[i].payload, commands[i].length);
+        }
+
+        entry->settle_ms = commands[i].settle_ms;
+        entry->batch_remaining = count - 1 - i;
+        entry->callback = cb;
+        entry->user_data = user_data;
+    }
+
+    data->cmd_count += count;
+    k_spin_unlock(&data->cmd_lock, key);
+
+    k_work_schedule_for_queue(&work_queue, &data->cmd_work, K_NO_WAIT);
+
+    return 0;
+}
+
+int px1122r_send_command_async(const struct device* dev, const void* command, uint16_t length, uint16_t settle_ms,
+                               px1122r_command_cb_t cb, void* user_data) {
+    const struct px1122r_command_t cmd = {.payload = command, .length = length, .settle_ms = settle_ms};
+
+    return px1122r_send_batch(dev, &cmd, 1, cb, user_data);
+}
+
+struct sync_command_t {
+    struct k_sem sem;
+    int result;
+};
+
+static void sync_command_cb(const struct device* dev, uint8_t msg_id, int result, void* user_data) {
+    ARG_UNUSED(dev);
+    ARG_UNUSED(msg_id);
+    struct sync_command_t* sync = user_data;
+
+    sync->result = result;
+    k_sem_give(&sync->sem);
+}
+
+static int send_batch_sync(const struct device* dev, const struct px1122r_command_t* commands, size_t count) {
+    struct sync_command_t sync;
+    k_sem_init(&sync.sem, 0, 1);
+
+    int err = px1122r_send_batch(dev, commands, count, sync_command_cb, &sync);
+    if (err != 0) {
+        return err;
+    }
+
+    k_sem_take(&sync.sem, K_FOREVER);
+
+    return sync.result;
+}
+
+static const uint32_t baudrates[] = {
+    [BAUDRATE_4800] = 4800,
+    [BAUDRATE_9600] = 9600,
+    [BAUDRATE_19200] = 19200,
+    [BAUDRATE_38400] = 38400,
+    [BAUDRATE_57600] = 57600,
+    [BAUDRATE_115200] = 115200,
+    [BAUDRATE_230400] = 230400,
+    [BAUDRATE_460800] = 460800,
+    [BAUDRATE_921600] = 921600,
+};
+
+static int set_uart_baudrate(struct px1122r_dev_data* data, uint32_t baudrate) {
+    struct uart_config cfg;
+
+    int err = uart_config_get(data->uart_dev, &cfg);
+    if (err != 0) {
+        return err;
+    }
+
+    cfg.baudrate = baudrate;
+
+    err = uart_configure(data->uart_dev, &cfg);
+    if (err == 0) {
+        data->stats.baudrate = baudrate;
+    }
+
+    return err;
+}
+
+static bool probe_receiver(const struct device* dev) {
+    static const uint8_t query[] = PX1122R_FRAME_QUERY_SW_VERSION;
+    const struct px1122r_command_t cmd = PX1122R_FRAMED(query);
+
+    // The first attempt at a new rate can be lost in whatever was still on the line.
+    for (int i = 0; i < 2; ++i) {
+        if (send_batch_sync(dev, &cmd, 1) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Tries the rate we're set to first, then the receiver's default, then everything else from the top down.
+static int detect_baudrate(const struct device* dev) {
+    struct px1122r_dev_data* data = dev->data;
+    struct uart_config cfg = {.baudrate = 0};
+
+    if (uart_config_get(data->uart_dev, &cfg) == 0) {
+        data->stats.baudrate = cfg.baudrate;
+
+        if (probe_receiver(dev)) {
+            return cfg.baudrate;
+        }
+    }
+
+    if (set_uart_baudrate(data, baudrates[BAUDRATE_115200]) == 0 && probe_receiver(dev)) {
+        return baudrates[BAUDRATE_115200];
+    }
+
+    for (int i = ARRAY_SIZE(baudrates) - 1; i >= 0; --i) {
+        if (i == BAUDRATE_115200 || baudrates[i] == cfg.baudrate) {
+            continue;
+        }
+
+        if (set_uart_baudrate(data, baudrates[i]) == 0 && probe_receiver(dev)) {
+            return baudrates[i];
+        }
+    }
+
+    return -EIO;
+}
+
+int px1122r_get_pps(const struct device* dev, struct px1122r_pps_edge_t* edge) {
+    struct px1122r_dev_data* data = dev->data;
+
+    if (!data->has_pps) {
+        return -ENOTSUP;
+    }
+
+    return pps_capture_get(&data->pps, k_cycle_get_32(), edge) ? 0 : -ENODATA;
+}
+
+int px1122r_negotiate_baudrate(const struct device* dev, uint32_t max_baudrate) {
+    struct px1122r_dev_data* data = dev->data;
+    int current = detect_baudrate(dev);
+
+    if (current < 0) {
+        LOG_ERR("No response from the receiver at any baud rate");
+        return current;
+    }
+
+    LOG_INF("Receiver found at %d baud", current);
+
+    for (int i = ARRAY_SIZE(baudrates) - 1; i >= 0 && baudrates[i] > current; --i) {
+        if (baudrates[i] > max_baudrate) {
+            continue;
+        }
+
+        const struct px1122r_cmd_serial_port_t port = PX1122R_CONFIG_SERIAL_PORT(i);
+
+        if (px1122r_send_command(dev, &port, sizeof(port)) != 0) {
+            continue;
+        }
+
+        // The receiver has ACKed at the old rate and is switching now.
+        set_uart_baudrate(data, baudrates[i]);
+        k_msleep(CONFIG_PX1122R_BAUDRATE_SETTLE_MS);
+
+        if (probe_receiver(dev)) {
+            current = baudrates[i];
+            break;
+        }
+
+        // We've lost track of which rate the receiver ended up at, so go and find it again.
+        LOG_WRN("Link didn't work at %d baud", baudrates[i]);
+        current = detect_baudrate(dev);
+
+        if (current < 0) {
+            LOG_ERR("Lost the receiver while changing baud rate");
+            return current;
+        }
+    }
+
+    // The rate is only known once data has been coming in at it for a while, so the worker logs it later.
+    LOG_INF("Using %d baud", current);
+    atomic_set(&data->rate_report, RATE_REPORT_RESTART);
+
+    return current;
+}
+
 int px1122r_start_stream(const struct device* dev, px1122r_callback_t cb) {
     struct px1122r_dev_data* data = dev->data;
     data->callback = cb;
     data->stream_mode = true;
-    uart_rx_enable(data->uart_dev, data->rx_bufs[data->cur_buf], BUF_SIZE, RX_BUF_TIMEOUT_US);
+    // RX is started from the work queue, as it may already be running for a command.
+    k_work_submit_to_queue(&work_queue, &data->rx_work);
     return 0;
 }
 
 int px1122r_stop_stream(const struct device* dev) {
     struct px1122r_dev_data* data = dev->data;
     data->stream_mode = false;
-    uart_rx_disable(data->uart_dev);
+    k_work_submit_to_queue(&work_queue, &data->rx_work);
 
     return 0;
 }
 
-int px1122r_send_command(const struct device* dev, const void* command, const uint16_t length) {
+int px1122r_get_stats(const struct device* dev, struct px1122r_stats_t* stats) {
     struct px1122r_dev_data* data = dev->data;
+    *stats = data->stats;
+    stats->nmea_sentences = data->nmea_framer.sentences;
+    stats->nmea_checksum_errors = data->nmea_framer.checksum_errors;
+    stats->nmea_framing_errors = data->nmea_framer.framing_errors;
+    stats->nmea_fixes = data->nmea_decoder.epochs;
+    stats->nmea_field_errors = data->nmea_decoder.field_errors;
+    stats->rtcm3_frames = data->rtcm3_framer.frames;
+    stats->rtcm3_crc_errors = data->rtcm3_framer.crc_errors;
+    stats->rtcm3_framing_errors = data->rtcm3_framer.framing_errors;
 
-    data->stream_mode = false;
-    uart_rx_enable(data->uart_dev, data->rx_bufs[data->cur_buf], BUF_SIZE, RX_BUF_TIMEOUT_US);
+    return 0;
+}
 
-    data->tx_buf[0] = 0xa0;
-    data->tx_buf[1] = 0xa1;
-    data->tx_buf[2] = length >> 8;
-    data->tx_buf[3] = length & 0xff;
-    memcpy(&data->tx_buf[4], command, length);
-    data->tx_buf[length + 4] = calc_checksum(command, length);
-    data->tx_buf[length + 5] = 0x0d;
-    data->tx_buf[length + 6] = 0x0a;
+static void corrections_uart_cb(const struct device* dev, struct uart_event* evt, void* user_data) {
+    const struct device* px1122r_dev = user_data;
+    struct px1122r_dev_data* data = px1122r_dev->data;
 
-    uart_tx(data->uart_dev, data->tx_buf, length + 7, SYS_FOREVER_US);
+    switch (evt->type) {
+        case UART_TX_DONE:
+        case UART_TX_ABORTED:
+            data->corrections_result = evt->type == UART_TX_DONE ? 0 : -EIO;
+            atomic_clear(&data->corrections_busy);
+            k_work_submit_to_queue(&work_queue, &data->corrections_work);
+            break;
 
-    int sem_ret = k_sem_take(&command_sem, K_MSEC(100));
-    if (sem_ret != 0) {
-        LOG_ERR("Failed to send command 0x%02x. %d", data->tx_buf[4], sem_ret);
-        uart_rx_disable(data->uart_dev);
-        return -1;
+        default:
+            break;
     }
+}
 
-    uart_rx_disable(data->uart_dev);
+// Starts the next non-empty buffer, moving on to the next frame when this one is done. A frame that fails part way
+// through is given up on, as the receiver will throw away what it got anyway.
+static void corrections_send_next(struct px1122r_dev_data* data) {
+    while (true) {
+        if (data->corrections_frag == NULL) {
+            if (data->corrections_frame.buf != NULL) {
+                data->corrections_frame.release(data->corrections_frame.buf);
+                data->corrections_frame.buf = NULL;
+            }
+
+            if (k_msgq_get(&data->corrections_queue, &data->corrections_frame, K_NO_WAIT) != 0) {
+                data->corrections_frame.buf = NULL;
+                return;
+            }
+
+            data->corrections_frag = data->corrections_frame.buf;
+        }
+
+        if (data->corrections_frag->len == 0) {
+            data->corrections_frag = data->corrections_frag->frags;
+
+            if (data->corrections_frag == NULL) {
+                data->stats.corrections_sent++;
+            }
+
+            continue;
+        }
+
+        atomic_set(&data->corrections_busy, 1);
+
+        int err = uart_tx(data->uart_dev2, data->corrections_frag->data, data->corrections_frag->len,
+                          SYS_FOREVER_US);
+
+        if (err == 0) {
+            return;
+        }
 
-    if (!data->command_response) {
-        LOG_ERR("NACK received");
-        return -1;
+        LOG_ERR("Failed to send corrections (err %d)", err);
+        atomic_clear(&data->corrections_busy);
+        data->stats.corrections_failed++;
+        data->corrections_frag = NULL;
     }
+}
+
+static void corrections_work_handler(struct k_work* work) {
+    struct px1122r_dev_data* data = CONTAINER_OF(work, struct px1122r_dev_data, corrections_work);
+
+    if (atomic_get(&data->corrections_busy)) {
+        return;
+    }
+
+    // Not busy with a buffer still set means the UART has just finished with it.
+    if (data->corrections_frag != NULL) {
+        if (data->corrections_result != 0) {
+            data->stats.corrections_failed++;
+            data->corrections_frag = NULL;
+        } else {
+            data->corrections_frag = data->corrections_frag->frags;
+
+            if (data->corrections_frag == NULL) {
+                data->stats.corrections_sent++;
+            }
+        }
+    }
+
+    corrections_send_next(data);
+}
+
+int px1122r_send_corrections(const struct device* dev, struct net_buf* buf, px1122r_release_cb_t release) {
+    struct px1122r_dev_data* data = dev->data;
+    struct corrections_item_t item = {.buf = buf, .release = release};
+
+    if (k_msgq_put(&data->corrections_queue, &item, K_NO_WAIT) != 0) {
+        data->stats.corrections_rejected++;
+        return -ENOBUFS;
+    }
+
+    k_work_submit_to_queue(&work_queue, &data->corrections_work);
 
     return 0;
 }
 
+int px1122r_send_command(const struct device* dev, const void* command, const uint16_t length) {
+    const struct px1122r_command_t cmd = {.payload = command, .length = length};
+
+    return send_batch_sync(dev, &cmd, 1);
+}
+
 #define PX1122R_DEFINE(inst)                                               \
     static struct px1122r_dev_data px1122r_data_##inst = {                 \
         .uart_dev = DEVICE_DT_GET(DT_INST_BUS(0)),                         \
         .uart_dev2 = DEVICE_DT_GET(DT_NODELABEL(uart1)),                   \
+        .onepps = GPIO_DT_SPEC_INST_GET_OR(inst, onepps_gpios, {0}),       \
         .stream_mode = false,                                              \
-        .cur_buf = 0,                                                      \
+        .next_slot = 0,                                                    \
         .callback = NULL,                                                  \
-        .command_response = false,                                         \
     };                                                                     \
     DEVICE_DT_INST_DEFINE(inst,                                            \
                           px1122r_init,                                    \
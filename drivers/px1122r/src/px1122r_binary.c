@@ -0,0 +1,99 @@
+#include "px1122r.h"
+
+#include <zephyr/sys/byteorder.h>
+#include <string.h>
+
+#define NAV_DATA_LEN 59
+#define MEAS_TIME_LEN 10
+#define RAW_MEAS_HEADER_LEN 3
+#define RAW_MEAS_CHANNEL_LEN 23
+
+// SkyTraq sends floating point values as big-endian IEEE 754.
+static double get_be_double(const uint8_t* buf) {
+    uint64_t raw = sys_get_be64(buf);
+    double value;
+
+    memcpy(&value, &raw, sizeof(value));
+
+    return value;
+}
+
+static float get_be_float(const uint8_t* buf) {
+    uint32_t raw = sys_get_be32(buf);
+    float value;
+
+    memcpy(&value, &raw, sizeof(value));
+
+    return value;
+}
+
+int px1122r_decode_nav_data(const uint8_t* payload, uint16_t len, struct px1122r_fix_t* fix) {
+    if (len < NAV_DATA_LEN || payload[0] != PX1122R_MSG_ID_NAV_DATA) {
+        return -EINVAL;
+    }
+
+    memset(fix, 0, sizeof(*fix));
+    fix->sources = PX1122R_FIX_FROM_NAV_DATA;
+    fix->fix_mode = payload[1];
+    fix->num_sv = payload[2];
+    fix->gps_week = sys_get_be16(&payload[3]);
+    // Sent in units of 10 ms.
+    fix->tow_ms = sys_get_be32(&payload[5]) * 10;
+    // The receiver already uses 1e-7 degrees and centimetres.
+    fix->latitude = (int32_t)sys_get_be32(&payload[9]);
+    fix->longitude = (int32_t)sys_get_be32(&payload[13]);
+    fix->ellipsoid_height = (int32_t)sys_get_be32(&payload[17]);
+    fix->altitude_msl = (int32_t)sys_get_be32(&payload[21]);
+    // GDOP at 25 and TDOP at 33 aren't kept.
+    fix->pdop = sys_get_be16(&payload[27]);
+    fix->hdop = sys_get_be16(&payload[29]);
+    fix->vdop = sys_get_be16(&payload[31]);
+    fix->ecef_x = (int32_t)sys_get_be32(&payload[35]);
+    fix->ecef_y = (int32_t)sys_get_be32(&payload[39]);
+    fix->ecef_z = (int32_t)sys_get_be32(&payload[43]);
+    fix->ecef_vx = (int32_t)sys_get_be32(&payload[47]);
+    fix->ecef_vy = (int32_t)sys_get_be32(&payload[51]);
+    fix->ecef_vz = (int32_t)sys_get_be32(&payload[55]);
+    // Closest GGA quality, so NMEA and binary fixes can be treated alike.
+    fix->quality = fix->fix_mode == 0 ? 0 : fix->fix_mode == 3 ? 2 : 1;
+
+    return 0;
+}
+
+int px1122r_decode_meas_time(const uint8_t* payload, uint16_t len, struct px1122r_meas_time_t* meas_time) {
+    if (len < MEAS_TIME_LEN || payload[0] != PX1122R_MSG_ID_MEAS_TIME) {
+        return -EINVAL;
+    }
+
+    meas_time->iod = payload[1];
+    meas_time->week = sys_get_be16(&payload[2]);
+    meas_time->tow_ms = sys_get_be32(&payload[4]);
+    meas_time->period_ms = sys_get_be16(&payload[8]);
+
+    return 0;
+}
+
+int px1122r_decode_raw_meas(const uint8_t* payload, uint16_t len, struct px1122r_raw_meas_t* meas, size_t max_meas) {
+    if (len < RAW_MEAS_HEADER_LEN || payload[0] != PX1122R_MSG_ID_RAW_MEAS) {
+        return -EINVAL;
+    }
+
+    uint8_t count = payload[2];
+
+    if (len < RAW_MEAS_HEADER_LEN + count * RAW_MEAS_CHANNEL_LEN) {
+        return -EINVAL;
+    }
+
+    const uint8_t* channel = &payload[RAW_MEAS_HEADER_LEN];
+
+    for (size_t i = 0; i < MIN(count, max_meas); ++i, channel += RAW_MEAS_CHANNEL_LEN) {
+        meas[i].svid = channel[0];
+        meas[i].cn0 = channel[1];
+        meas[i].pseudorange = get_be_double(&channel[2]);
+        meas[i].carrier_phase = get_be_double(&channel[10]);
+        meas[i].doppler = get_be_float(&channel[18]);
+        meas[i].channel_indicator = channel[22];
+    }
+
+    return count;
+}
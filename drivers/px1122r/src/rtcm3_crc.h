@@ -0,0 +1,11 @@
+#ifndef _RTCM3_CRC_H_
+#define _RTCM3_CRC_H_
+
+#include <zephyr/types.h>
+#include <zephyr/sys/byteorder.h>
+#include <stddef.h>
+
+// Returns the 24-bit CRC-24Q of the buffer in the low bits of the result.
+uint32_t rtcm3_crc24q(const uint8_t* buf, size_t len);
+
+#endif
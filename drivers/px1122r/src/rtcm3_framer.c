@@ -0,0 +1,163 @@
+#include "rtcm3_framer.h"
+#include "rtcm3_crc.h"
+
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include <string.h>
+
+// Upper six bits of the two length bytes are reserved and always zero.
+#define RTCM3_RESERVED_MASK 0xfc
+
+static bool check_frame(struct rtcm3_framer_t* framer, const uint8_t* frame, uint16_t len) {
+    uint32_t crc = rtcm3_crc24q(frame, len - RTCM3_CRC_LEN);
+
+    if (crc != sys_get_be24(&frame[len - RTCM3_CRC_LEN])) {
+        framer->crc_errors++;
+        return false;
+    }
+
+    framer->frames++;
+
+    if (framer->callback != NULL) {
+        // An empty payload is legal, it just doesn't have a message number.
+        uint16_t msg_type = len > RTCM3_HEADER_LEN + RTCM3_CRC_LEN + 1 ? sys_get_be16(&frame[RTCM3_HEADER_LEN]) >> 4 : 0;
+        framer->callback(frame, len, msg_type, framer->user_data);
+    }
+
+    return true;
+}
+
+// What's held in scratch came from earlier spans and can't be handed back, so after a bad frame it's searched here for
+// the next preamble, from index from up to held. Returns true if there's one, moved to the front of scratch.
+static bool rescan(struct rtcm3_framer_t* framer, uint16_t from, uint16_t held) {
+    const uint8_t* next = from < held ? memchr(&framer->scratch[from], RTCM3_PREAMBLE, held - from) : NULL;
+
+    if (next == NULL) {
+        rtcm3_framer_reset(framer);
+        return false;
+    }
+
+    framer->stitched = held - (next - framer->scratch);
+    memmove(framer->scratch, next, framer->stitched);
+    framer->frame_len = 0;
+
+    return true;
+}
+
+void rtcm3_framer_init(struct rtcm3_framer_t* framer, rtcm3_frame_cb_t callback, void* user_data) {
+    memset(framer, 0, offsetof(struct rtcm3_framer_t, scratch));
+    framer->callback = callback;
+    framer->user_data = user_data;
+}
+
+void rtcm3_framer_reset(struct rtcm3_framer_t* framer) {
+    framer->in_frame = false;
+    framer->stitched = 0;
+    framer->frame_len = 0;
+}
+
+size_t rtcm3_framer_feed(struct rtcm3_framer_t* framer, const uint8_t* buf, size_t len) {
+    const uint8_t* start = buf;
+
+    if (!framer->in_frame) {
+        start = memchr(buf, RTCM3_PREAMBLE, len);
+
+        if (start == NULL) {
+            return len;
+        }
+
+        len -= start - buf;
+        framer->in_frame = true;
+        framer->stitched = 0;
+        framer->frame_len = 0;
+
+        if (len >= RTCM3_HEADER_LEN) {
+            if ((start[1] & RTCM3_RESERVED_MASK) != 0) {
+                framer->framing_errors++;
+                rtcm3_framer_reset(framer);
+                return start - buf + 1;
+            }
+
+            framer->frame_len = (sys_get_be16(&start[1]) & 0x3ff) + RTCM3_HEADER_LEN + RTCM3_CRC_LEN;
+
+            if (len >= framer->frame_len) {
+                // The whole frame is here, so check it where it lies.
+                bool ok = check_frame(framer, start, framer->frame_len);
+                size_t consumed = start - buf + (ok ? framer->frame_len : 1);
+
+                rtcm3_framer_reset(framer);
+                return consumed;
+            }
+        }
+
+        memcpy(framer->scratch, start, len);
+        framer->stitched = len;
+        return start - buf + len;
+    }
+
+    // Continuing a frame from an earlier span. If it turns out bad, what came from buf is handed back and only what
+    // was held from earlier spans is searched again, so a false preamble costs no more than the one-span case.
+    size_t consumed = 0;
+    uint16_t held = framer->stitched;
+
+    while (true) {
+        if (framer->stitched < RTCM3_HEADER_LEN) {
+            size_t count = MIN(len - consumed, (size_t)(RTCM3_HEADER_LEN - framer->stitched));
+
+            memcpy(&framer->scratch[framer->stitched], &buf[consumed], count);
+            framer->stitched += count;
+            consumed += count;
+
+            if (framer->stitched < RTCM3_HEADER_LEN) {
+                return consumed;
+            }
+        }
+
+        if (framer->frame_len == 0) {
+            if ((framer->scratch[1] & RTCM3_RESERVED_MASK) != 0) {
+                framer->framing_errors++;
+
+                if (!rescan(framer, 1, held)) {
+                    return 0;
+                }
+
+                held = framer->stitched;
+                consumed = 0;
+                continue;
+            }
+
+            framer->frame_len = (sys_get_be16(&framer->scratch[1]) & 0x3ff) + RTCM3_HEADER_LEN + RTCM3_CRC_LEN;
+        }
+
+        if (framer->stitched < framer->frame_len) {
+            size_t count = MIN(len - consumed, (size_t)(framer->frame_len - framer->stitched));
+
+            memcpy(&framer->scratch[framer->stitched], &buf[consumed], count);
+            framer->stitched += count;
+            consumed += count;
+
+            if (framer->stitched < framer->frame_len) {
+                return consumed;
+            }
+        }
+
+        if (check_frame(framer, framer->scratch, framer->frame_len)) {
+            uint16_t end = framer->frame_len;
+
+            if (end >= held) {
+                rtcm3_framer_reset(framer);
+                return consumed;
+            }
+
+            // After a rescan the whole frame can be in what was held, with more after it. Nothing came from buf.
+            if (!rescan(framer, end, held)) {
+                return 0;
+            }
+        } else if (!rescan(framer, 1, held)) {
+            return 0;
+        }
+
+        held = framer->stitched;
+        consumed = 0;
+    }
+}
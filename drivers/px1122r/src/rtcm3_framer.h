@@ -0,0 +1,50 @@
+#ifndef _RTCM3_FRAMER_H_
+#define _RTCM3_FRAMER_H_
+
+#include <zephyr/types.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define RTCM3_PREAMBLE 0xd3
+#define RTCM3_HEADER_LEN 3
+#define RTCM3_CRC_LEN 3
+#define RTCM3_MAX_PAYLOAD_LEN 1023
+#define RTCM3_MAX_FRAME_LEN (RTCM3_HEADER_LEN + RTCM3_MAX_PAYLOAD_LEN + RTCM3_CRC_LEN)
+
+// Called for every frame with a good CRC. frame points at the preamble, len covers the header, payload and CRC, and
+// msg_type is the 12-bit message number from the start of the payload. frame is only valid for the duration of the
+// call.
+typedef void (* rtcm3_frame_cb_t)(const uint8_t* frame, uint16_t len, uint16_t msg_type, void* user_data);
+
+// Finds RTCM 3 frames in a byte stream. Like the NMEA framer, a frame that lies inside one fed span is passed on in
+// place, and only frames that straddle spans are stitched together in the scratch buffer.
+struct rtcm3_framer_t {
+    bool in_frame;
+    // Bytes of the current frame already held in scratch, and how long the frame is once we know.
+    uint16_t stitched;
+    uint16_t frame_len;
+    rtcm3_frame_cb_t callback;
+    void* user_data;
+
+    uint32_t frames;
+    uint32_t crc_errors;
+    uint32_t framing_errors;
+
+    uint8_t scratch[RTCM3_MAX_FRAME_LEN];
+};
+
+void rtcm3_framer_init(struct rtcm3_framer_t* framer, rtcm3_frame_cb_t callback, void* user_data);
+
+void rtcm3_framer_reset(struct rtcm3_framer_t* framer);
+
+// Consumes bytes up to and including the end of the next frame and returns how many were consumed. When the CRC
+// doesn't match, only the preamble byte is consumed so the rest can be searched for the real start of a frame. For a
+// frame stitched across spans, the bytes held from earlier spans are searched again here and those in buf are handed
+// back, so it can return 0. Bytes before a preamble are skipped.
+size_t rtcm3_framer_feed(struct rtcm3_framer_t* framer, const uint8_t* buf, size_t len);
+
+static inline bool rtcm3_framer_is_idle(const struct rtcm3_framer_t* framer) {
+    return !framer->in_frame;
+}
+
+#endif
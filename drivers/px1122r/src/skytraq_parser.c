@@ -0,0 +1,133 @@
+#include "skytraq_parser.h"
+#include "xor_checksum.h"
+
+#include <zephyr/sys/util.h>
+#include <string.h>
+
+#define SKYTRAQ_POSTAMBLE_1 0x0d
+#define SKYTRAQ_POSTAMBLE_2 0x0a
+
+void skytraq_parser_init(struct skytraq_parser_t* parser, skytraq_frame_cb_t callback, void* user_data) {
+    memset(parser, 0, offsetof(struct skytraq_parser_t, payload));
+    parser->callback = callback;
+    parser->user_data = user_data;
+}
+
+void skytraq_parser_reset(struct skytraq_parser_t* parser) {
+    parser->state = SKYTRAQ_STATE_IDLE;
+}
+
+size_t skytraq_parser_feed(struct skytraq_parser_t* parser, const uint8_t* buf, size_t len) {
+    const uint8_t* current = buf;
+    const uint8_t* end = buf + len;
+
+    while (current < end) {
+        switch (parser->state) {
+            case SKYTRAQ_STATE_IDLE: {
+                const uint8_t* sync = memchr(current, SKYTRAQ_SYNC_1, end - current);
+
+                if (sync == NULL) {
+                    return len;
+                }
+
+                current = sync + 1;
+                parser->state = SKYTRAQ_STATE_SYNC;
+                break;
+            }
+
+            case SKYTRAQ_STATE_SYNC:
+                if (*current != SKYTRAQ_SYNC_2) {
+                    // Leave the byte where it is. It might be the start of something else.
+                    parser->state = SKYTRAQ_STATE_IDLE;
+                    parser->framing_errors++;
+                    return current - buf;
+                }
+
+                current++;
+                parser->state = SKYTRAQ_STATE_LENGTH_MSB;
+                break;
+
+            case SKYTRAQ_STATE_LENGTH_MSB:
+                parser->payload_len = *current++ << 8;
+                parser->state = SKYTRAQ_STATE_LENGTH_LSB;
+                break;
+
+            case SKYTRAQ_STATE_LENGTH_LSB:
+                parser->payload_len |= *current++;
+
+                // A stray or corrupted header can claim up to 64 KiB, which would swallow seconds of the live stream
+                // if we skipped over it. The length bytes in this feed are handed back, they might start something.
+                if (parser->payload_len == 0 || parser->payload_len > sizeof(parser->payload)) {
+                    size_t consumed = current - buf;
+
+                    if (parser->payload_len == 0) {
+                        parser->framing_errors++;
+                    } else {
+                        parser->oversized_frames++;
+                    }
+
+                    parser->state = SKYTRAQ_STATE_IDLE;
+                    return consumed >= 2 ? consumed - 2 : 0;
+                }
+
+                parser->received = 0;
+                parser->checksum = 0;
+                parser->state = SKYTRAQ_STATE_PAYLOAD;
+                break;
+
+            case SKYTRAQ_STATE_PAYLOAD: {
+                uint16_t count = MIN(end - current, parser->payload_len - parser->received);
+
+                memcpy(&parser->payload[parser->received], current, count);
+                parser->checksum ^= xor_checksum(current, count);
+                parser->received += count;
+                current += count;
+
+                if (parser->received == parser->payload_len) {
+                    parser->state = SKYTRAQ_STATE_CHECKSUM;
+                }
+                break;
+            }
+
+            case SKYTRAQ_STATE_CHECKSUM:
+                if (*current++ != parser->checksum) {
+                    parser->state = SKYTRAQ_STATE_IDLE;
+                    parser->checksum_errors++;
+                    return current - buf;
+                }
+
+                parser->state = SKYTRAQ_STATE_POSTAMBLE_1;
+                break;
+
+            case SKYTRAQ_STATE_POSTAMBLE_1:
+                if (*current != SKYTRAQ_POSTAMBLE_1) {
+                    parser->state = SKYTRAQ_STATE_IDLE;
+                    parser->framing_errors++;
+                    return current - buf;
+                }
+
+                current++;
+                parser->state = SKYTRAQ_STATE_POSTAMBLE_2;
+                break;
+
+            case SKYTRAQ_STATE_POSTAMBLE_2:
+                if (*current != SKYTRAQ_POSTAMBLE_2) {
+                    parser->state = SKYTRAQ_STATE_IDLE;
+                    parser->framing_errors++;
+                    return current - buf;
+                }
+
+                current++;
+                parser->state = SKYTRAQ_STATE_IDLE;
+                parser->frames++;
+
+                if (parser->callback != NULL) {
+                    parser->callback(parser->payload, parser->payload_len, parser->user_data);
+                }
+
+                return current - buf;
+        }
+    }
+
+    return len;
+}
@@ -0,0 +1,60 @@
+#ifndef _SKYTRAQ_PARSER_H_
+#define _SKYTRAQ_PARSER_H_
+
+#include <zephyr/types.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SKYTRAQ_SYNC_1 0xa0
+#define SKYTRAQ_SYNC_2 0xa1
+
+// Called for every complete frame with a valid checksum. The payload starts with the message ID and is only valid
+// for the duration of the call.
+typedef void (* skytraq_frame_cb_t)(const uint8_t* payload, uint16_t len, void* user_data);
+
+enum skytraq_parser_state_t {
+    SKYTRAQ_STATE_IDLE,
+    SKYTRAQ_STATE_SYNC,
+    SKYTRAQ_STATE_LENGTH_MSB,
+    SKYTRAQ_STATE_LENGTH_LSB,
+    SKYTRAQ_STATE_PAYLOAD,
+    SKYTRAQ_STATE_CHECKSUM,
+    SKYTRAQ_STATE_POSTAMBLE_1,
+    SKYTRAQ_STATE_POSTAMBLE_2
+};
+
+// Incremental parser for SkyTraq binary frames: 0xa0 0xa1 <length:2> <payload> <checksum> 0x0d 0x0a.
+// All state lives in the struct, so there can be one per device and frames may be split across any number of feeds.
+struct skytraq_parser_t {
+    enum skytraq_parser_state_t state;
+    uint16_t payload_len;
+    uint16_t received;
+    uint8_t checksum;
+    skytraq_frame_cb_t callback;
+    void* user_data;
+
+    uint32_t frames;
+    uint32_t checksum_errors;
+    uint32_t framing_errors;
+    // Headers claiming more payload than fits in the buffer. They're given up on straight away, like framing errors.
+    uint32_t oversized_frames;
+
+    uint8_t payload[CONFIG_PX1122R_MAX_PAYLOAD_SIZE];
+};
+
+void skytraq_parser_init(struct skytraq_parser_t* parser, skytraq_frame_cb_t callback, void* user_data);
+
+void skytraq_parser_reset(struct skytraq_parser_t* parser);
+
+// Consumes bytes up to and including the end of the next frame, or up to the point where a partial frame turned out
+// to be garbage, and returns how many were consumed. Call it again with the remainder to pick up any following
+// frames. Bytes before a sync byte are skipped. A header with a zero or oversized length is abandoned before its
+// length bytes, so they get looked at again. It can return 0 when a frame is abandoned near the start of a feed, in
+// which case the bytes from there on haven't been looked at as a possible start of frame yet.
+size_t skytraq_parser_feed(struct skytraq_parser_t* parser, const uint8_t* buf, size_t len);
+
+static inline bool skytraq_parser_is_idle(const struct skytraq_parser_t* parser) {
+    return parser->state == SKYTRAQ_STATE_IDLE;
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef _XOR_CHECKSUM_H_
+#define _XOR_CHECKSUM_H_
+
+#include <zephyr/types.h>
+#include <stddef.h>
+
+// XOR of every byte in the buffer, as used by both NMEA and SkyTraq binary framing. Works a 32-bit word at a time
+// once the pointer is aligned, and folds the word down to a byte at the end.
+static inline uint8_t xor_checksum(const uint8_t* buf, size_t len) {
+    uint8_t cs = 0;
+
+    while (len > 0 && ((uintptr_t)buf & 0x3) != 0) {
+        cs ^= *buf++;
+        --len;
+    }
+
+    const uint32_t* words = (const uint32_t*)buf;
+    uint32_t acc = 0;
+
+    for (size_t i = 0; i < len / 4; ++i) {
+        acc ^= words[i];
+    }
+
+    acc ^= acc >> 16;
+    acc ^= acc >> 8;
+    cs ^= (uint8_t)acc;
+
+    buf += len & ~(size_t)0x3;
+    len &= 0x3;
+
+    while (len-- > 0) {
+        cs ^= *buf++;
+    }
+
+    return cs;
+}
+
+#endif
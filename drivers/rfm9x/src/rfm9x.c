@@ -2,10 +2,12 @@
 
 #include <zephyr/types.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/drivers/gpio.h>
 #include <zephyr/drivers/spi.h>
 #include <zephyr/drivers/sensor.h>
 #include <zephyr/sys/byteorder.h>
 #include <zephyr/drivers/lora.h>
+#include <string.h>
 
 
 #define LOG_LEVEL CONFIG_RFM9x_LOG_LEVEL
@@ -13,22 +15,115 @@
 
 #define REG_SPI_WRITE_BIT        BIT(7)
 
+#define WORKER_STACK_SIZE 1024
+#define WORKER_PRIORITY 5
+
+// Room for a full FIFO load plus the handful of registers either side of it.
+#define TXN_MAX_BURSTS 16
+#define TXN_DATA_SIZE (RH_RF95_MAX_PAYLOAD_LEN + 32)
+#define TXN_QUEUE_SIZE 4
+
+// Packet RSSI is relative to this on the high frequency port, and to 164 on the low one below 525 MHz.
+#define RSSI_OFFSET_HF 157
+#define RSSI_OFFSET_LF 164
+#define LF_PORT_MAX_FREQUENCY 525000000
+
+// Everything up to the PA DAC, which covers all the registers the driver sets.
+#define SHADOW_SIZE (RH_RF95_REG_4D_PA_DAC + 1)
+
+typedef void (*rfm9x_txn_cb_t)(const struct device* dev, int result, void* user_data);
+
+// A sequence of register writes that goes out as one unit. Writes to consecutive registers are merged into a single
+// burst, the chip steps the address along by itself, and each burst is one SPI transfer with the address byte in
+// front of its data. The data lives in here rather than with the caller, so it can be queued and forgotten about.
+struct rfm9x_txn_t {
+    uint8_t num_bursts;
+    bool overflow;
+    uint16_t used;
+    struct {
+        uint16_t offset;
+        uint16_t len;
+    } bursts[TXN_MAX_BURSTS];
+    uint8_t data[TXN_DATA_SIZE];
+    // Called once from the worker when the last burst is done or the first one fails.
+    rfm9x_txn_cb_t callback;
+    void* user_data;
+};
+
+// Somewhere on the caller's stack for the worker to leave a result, so callers can't wake each other up.
+struct rfm9x_txn_wait_t {
+    struct k_sem done;
+    int result;
+};
+
 struct rfm9x_dev_data_t {
     uint16_t voltage;
+    const struct device* dev;
+    // One API call at a time, they all leave the modem in a known mode.
+    struct k_mutex lock;
+    struct lora_modem_config config;
+    // Set from starting a transmission until it's done, failed or timed out, whichever gets there first.
+    atomic_t tx_busy;
+    // Where the result goes, on the stack of the lora_send caller or raised for lora_send_async. Both are only changed
+    // while tx_busy is clear.
+    struct rfm9x_txn_wait_t* tx_wait;
+    struct k_poll_signal* tx_signal;
+    int64_t tx_deadline;
+    // DIO0 or the poll timer gets the IRQ flags read here, as that can't be done from an ISR.
+    struct k_work_delayable irq_work;
+    struct gpio_callback dio0_cb;
+    // Set while receiving. Called from the driver's work queue with each packet that passes its CRC, which is read
+    // out of the FIFO into rx_buf in one burst.
+    lora_recv_cb rx_cb;
+    uint8_t rx_buf[RH_RF95_MAX_PAYLOAD_LEN];
+    uint32_t rx_crc_errors;
+    // Where lora_recv wants its one packet. NULL once it has stopped waiting, as the worker can still be on its way
+    // into the callback. It has its own lock, as lora_recv_async holds the mutex while it waits for the worker.
+    struct {
+        struct k_spinlock lock;
+        uint8_t* data;
+        uint8_t size;
+        uint8_t len;
+        int16_t rssi;
+        int8_t snr;
+        struct k_sem done;
+    } rx_sync;
+    struct k_msgq txn_queue;
+    char __aligned(4) txn_queue_buf[TXN_QUEUE_SIZE * sizeof(struct rfm9x_txn_t)];
+    struct k_work txn_work;
+    // What the settings registers were last set to, so changing a few bits doesn't need a read first and writing the
+    // same value again can be skipped. Cleared if a write fails, as there's no knowing how far it got.
+    uint8_t shadow[SHADOW_SIZE];
+    atomic_t shadow_valid;
 };
 
 struct rfm9x_dev_cfg_t {
     struct spi_dt_spec bus;
     struct gpio_dt_spec reset_gpio;
     struct gpio_dt_spec enable_gpio;
+    struct gpio_dt_spec dio0_gpio;
 };
 
 static int rfm9x_lora_config(const struct device* dev, struct lora_modem_config* config);
 
+static int rfm9x_lora_send(const struct device* dev, uint8_t* data, uint32_t data_len);
+
+static int rfm9x_lora_send_async(const struct device* dev, uint8_t* data, uint32_t data_len,
+                                 struct k_poll_signal* async);
+
+static int rfm9x_lora_recv(const struct device* dev, uint8_t* data, uint8_t size, k_timeout_t timeout, int16_t* rssi,
+                           int8_t* snr);
+
+static int rfm9x_lora_recv_async(const struct device* dev, lora_recv_cb cb);
+
 static int rfm9x_init(const struct device* dev);
 
 static const struct lora_driver_api rfm9x_api = {
-        .config = rfm9x_lora_config
+        .config = rfm9x_lora_config,
+        .send = rfm9x_lora_send,
+        .send_async = rfm9x_lora_send_async,
+        .recv = rfm9x_lora_recv,
+        .recv_async = rfm9x_lora_recv_async,
 };
 
 #define RFM9x_DEFINE(inst)                                         \
@@ -38,6 +133,7 @@ static const struct lora_driver_api rfm9x_api = {
         .bus = SPI_DT_SPEC_INST_GET(inst, SPI_WORD_SET(8) | SPI_OP_MODE_MASTER | SPI_TRANSFER_MSB, 0),                        \
         .reset_gpio = GPIO_DT_SPEC_INST_GET_OR(inst, rst_gpios, {}),        \
         .enable_gpio = GPIO_DT_SPEC_INST_GET_OR(inst, en_gpios, {}),        \
+        .dio0_gpio = GPIO_DT_SPEC_INST_GET_OR(inst, dio0_gpios, {}),        \
     };                                                             \
     DEVICE_DT_INST_DEFINE(inst,                                    \
                           rfm9x_init,                              \
@@ -51,29 +147,13 @@ DT_INST_FOREACH_STATUS_OKAY(RFM9x_DEFINE)
 
 LOG_MODULE_REGISTER(RFM9x, LOG_LEVEL);
 
-void rfm9x_read_cb(const struct device *dev, int result, void *data) {}
-void rfm9x_write_cb(const struct device *dev, int result, void *data) {}
-
-static int rfm9x_write_register(const struct spi_dt_spec* bus, uint8_t reg, uint8_t data) {
-    reg |= REG_SPI_WRITE_BIT;
-
-    uint8_t buf[2] = {reg, data};
-
-    const struct spi_buf tx_buf = {
-            .buf = buf,
-            .len = 2,
-    };
-
-    const struct spi_buf_set tx = {
-            .buffers = &tx_buf,
-            .count = 1,
-    };
+K_THREAD_STACK_DEFINE(worker_stack_area, WORKER_STACK_SIZE);
 
-//    return spi_write_dt(bus, &tx);
-    return spi_transceive_cb(bus->bus, &bus->config, &tx, NULL, rfm9x_write_cb, NULL);
-}
+// All register writes, and the IRQ handling that follows them, happen here one after the other.
+static struct k_work_q work_queue;
 
-static int rfm9x_read_register(const struct spi_dt_spec* bus, uint8_t reg, uint8_t* data) {
+// Reads consecutive registers in one transfer.
+static int rfm9x_read_burst(const struct spi_dt_spec* bus, uint8_t reg, uint8_t* data, size_t len) {
     const struct spi_buf tx_buf = {
             .buf = &reg,
             .len = 1,
@@ -91,7 +171,7 @@ static int rfm9x_read_register(const struct spi_dt_spec* bus, uint8_t reg, uint8
             },
             {
                     .buf = data,
-                    .len = 1,
+                    .len = len,
             }
     };
 
@@ -100,11 +180,408 @@ static int rfm9x_read_register(const struct spi_dt_spec* bus, uint8_t reg, uint8
             .count = 2,
     };
 
-    return spi_transceive_cb(bus->bus, &bus->config, &tx, &rx, rfm9x_read_cb, NULL);
+    return spi_transceive_dt(bus, &tx, &rx);
+}
+
+static int rfm9x_read_register(const struct spi_dt_spec* bus, uint8_t reg, uint8_t* data) {
+    return rfm9x_read_burst(bus, reg, data, 1);
+}
+
+static void rfm9x_txn_init(struct rfm9x_txn_t* txn) {
+    txn->num_bursts = 0;
+    txn->overflow = false;
+    txn->used = 0;
+    txn->callback = NULL;
+    txn->user_data = NULL;
+}
+
+static uint8_t* rfm9x_txn_start_burst(struct rfm9x_txn_t* txn, uint8_t reg, uint16_t len) {
+    if (txn->num_bursts == TXN_MAX_BURSTS || txn->used + 1 + len > TXN_DATA_SIZE) {
+        txn->overflow = true;
+        return NULL;
+    }
+
+    uint8_t* p = &txn->data[txn->used];
+
+    p[0] = reg | REG_SPI_WRITE_BIT;
+    txn->bursts[txn->num_bursts].offset = txn->used;
+    txn->bursts[txn->num_bursts].len = 1 + len;
+    txn->num_bursts++;
+    txn->used += 1 + len;
+
+    return p + 1;
+}
+
+static void rfm9x_txn_write(struct rfm9x_txn_t* txn, uint8_t reg, uint8_t value) {
+    if (txn->num_bursts > 0 && reg != RH_RF95_REG_00_FIFO) {
+        uint16_t offset = txn->bursts[txn->num_bursts - 1].offset;
+        uint16_t len = txn->bursts[txn->num_bursts - 1].len;
+        uint8_t first = txn->data[offset] & ~REG_SPI_WRITE_BIT;
+
+        // Carries on from the last burst, as long as that isn't the FIFO which doesn't move the address along.
+        if (first != RH_RF95_REG_00_FIFO && first + len - 1 == reg && txn->used < TXN_DATA_SIZE) {
+            txn->data[txn->used++] = value;
+            txn->bursts[txn->num_bursts - 1].len++;
+            return;
+        }
+    }
+
+    uint8_t* p = rfm9x_txn_start_burst(txn, reg, 1);
+
+    if (p != NULL) {
+        *p = value;
+    }
+}
+
+// Only the registers the modem leaves alone. The rest are status, or change by themselves as it sends and receives,
+// and always get written.
+static bool rfm9x_cacheable(uint8_t reg) {
+    switch (reg) {
+        case RH_RF95_REG_06_FRF_MSB:
+        case RH_RF95_REG_07_FRF_MID:
+        case RH_RF95_REG_08_FRF_LSB:
+        case RH_RF95_REG_09_PA_CONFIG:
+        case RH_RF95_REG_0A_PA_RAMP:
+        case RH_RF95_REG_0B_OCP:
+        case RH_RF95_REG_0C_LNA:
+        case RH_RF95_REG_0E_FIFO_TX_BASE_ADDR:
+        case RH_RF95_REG_0F_FIFO_RX_BASE_ADDR:
+        case RH_RF95_REG_11_IRQ_FLAGS_MASK:
+        case RH_RF95_REG_1D_MODEM_CONFIG1:
+        case RH_RF95_REG_1E_MODEM_CONFIG2:
+        case RH_RF95_REG_1F_SYMB_TIMEOUT_LSB:
+        case RH_RF95_REG_20_PREAMBLE_MSB:
+        case RH_RF95_REG_21_PREAMBLE_LSB:
+        case RH_RF95_REG_23_MAX_PAYLOAD_LENGTH:
+        case RH_RF95_REG_24_HOP_PERIOD:
+        case RH_RF95_REG_26_MODEM_CONFIG3:
+        case RH_RF95_REG_40_DIO_MAPPING1:
+        case RH_RF95_REG_41_DIO_MAPPING2:
+        case RH_RF95_REG_4D_PA_DAC:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// A write through the shadow, which is dropped if the register already has that value. The shadow is updated here
+// rather than once the transaction is done, so the caller has to hold the lock until it's queued.
+static void rfm9x_txn_update(struct rfm9x_dev_data_t* data, struct rfm9x_txn_t* txn, uint8_t reg, uint8_t value) {
+    if (!rfm9x_cacheable(reg)) {
+        rfm9x_txn_write(txn, reg, value);
+        return;
+    }
+
+    if (atomic_get(&data->shadow_valid) && data->shadow[reg] == value) {
+        return;
+    }
+
+    data->shadow[reg] = value;
+    rfm9x_txn_write(txn, reg, value);
+}
+
+// All the registers in one go, straight after reset and again after a failed write. Needs the modem in LoRa mode
+// already, as the registers from 0x0d up are different in FSK mode.
+static int rfm9x_shadow_load(const struct device* dev) {
+    const struct rfm9x_dev_cfg_t* const spi = dev->config;
+    struct rfm9x_dev_data_t* data = dev->data;
+
+    int ret = rfm9x_read_burst(&spi->bus, RH_RF95_REG_01_OP_MODE, &data->shadow[RH_RF95_REG_01_OP_MODE],
+                               SHADOW_SIZE - RH_RF95_REG_01_OP_MODE);
+
+    if (ret == 0) {
+        atomic_set(&data->shadow_valid, 1);
+    }
+
+    return ret;
+}
+
+// The payload is copied in, so the caller's buffer is free as soon as this returns.
+static void rfm9x_txn_write_fifo(struct rfm9x_txn_t* txn, const uint8_t* buf, uint16_t len) {
+    uint8_t* p = rfm9x_txn_start_burst(txn, RH_RF95_REG_00_FIFO, len);
+
+    if (p != NULL) {
+        memcpy(p, buf, len);
+    }
+}
+
+static int rfm9x_txn_execute(const struct spi_dt_spec* bus, const struct rfm9x_txn_t* txn) {
+    if (txn->overflow) {
+        return -ENOMEM;
+    }
+
+    for (uint8_t i = 0; i < txn->num_bursts; ++i) {
+        const struct spi_buf tx_buf = {
+                .buf = (uint8_t*) &txn->data[txn->bursts[i].offset],
+                .len = txn->bursts[i].len,
+        };
+
+        const struct spi_buf_set tx = {
+                .buffers = &tx_buf,
+                .count = 1,
+        };
+
+        int ret = spi_write_dt(bus, &tx);
+
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+static void rfm9x_txn_work_handler(struct k_work* work) {
+    struct rfm9x_dev_data_t* data = CONTAINER_OF(work, struct rfm9x_dev_data_t, txn_work);
+    const struct rfm9x_dev_cfg_t* const spi = data->dev->config;
+    // Off the stack, and there's only the one worker to use it.
+    static struct rfm9x_txn_t txn;
+
+    while (k_msgq_get(&data->txn_queue, &txn, K_NO_WAIT) == 0) {
+        int ret = rfm9x_txn_execute(&spi->bus, &txn);
+
+        if (ret != 0) {
+            LOG_ERR("Register write failed (err %d)", ret);
+            atomic_clear(&data->shadow_valid);
+        }
+
+        if (txn.callback != NULL) {
+            txn.callback(data->dev, ret, txn.user_data);
+        }
+    }
+}
+
+// Queues the whole sequence for the worker. Must not be called from the worker itself, that uses rfm9x_txn_execute.
+static int rfm9x_txn_submit(const struct device* dev, const struct rfm9x_txn_t* txn) {
+    struct rfm9x_dev_data_t* data = dev->data;
+
+    if (txn->overflow) {
+        return -ENOMEM;
+    }
+
+    int ret = k_msgq_put(&data->txn_queue, txn, K_FOREVER);
+
+    if (ret == 0) {
+        k_work_submit_to_queue(&work_queue, &data->txn_work);
+    }
+
+    return ret;
+}
+
+static void rfm9x_txn_wait_cb(const struct device* dev, int result, void* user_data) {
+    ARG_UNUSED(dev);
+
+    struct rfm9x_txn_wait_t* wait = user_data;
+
+    wait->result = result;
+    k_sem_give(&wait->done);
+}
+
+static int rfm9x_txn_submit_and_wait(const struct device* dev, struct rfm9x_txn_t* txn) {
+    struct rfm9x_txn_wait_t wait = {.result = 0};
+
+    k_sem_init(&wait.done, 0, 1);
+    txn->callback = rfm9x_txn_wait_cb;
+    txn->user_data = &wait;
+
+    int ret = rfm9x_txn_submit(dev, txn);
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    k_sem_take(&wait.done, K_FOREVER);
+
+    return wait.result;
+}
+
+static void rfm9x_finish_tx(struct rfm9x_dev_data_t* data, int result) {
+    // Taken before tx_busy is cleared, as the next sender can set its own as soon as it is.
+    struct k_poll_signal* signal = data->tx_signal;
+    struct rfm9x_txn_wait_t* wait = data->tx_wait;
+
+    // The timeout and the TX done interrupt can race, only the first one counts.
+    if (!atomic_cas(&data->tx_busy, 1, 0)) {
+        return;
+    }
+
+    if (signal != NULL) {
+        k_poll_signal_raise(signal, result);
+    } else if (wait != NULL) {
+        rfm9x_txn_wait_cb(data->dev, result, wait);
+    }
+}
+
+// Back to receiving from the start of the FIFO, for lora_recv_async and after sending a packet while receiving.
+static void rfm9x_rx_start(struct rfm9x_dev_data_t* data, struct rfm9x_txn_t* txn) {
+    rfm9x_txn_write(txn, RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_STDBY | RH_RF95_LONG_RANGE_MODE);
+    rfm9x_txn_write(txn, RH_RF95_REG_0D_FIFO_ADDR_PTR, 0);
+    rfm9x_txn_write(txn, RH_RF95_REG_12_IRQ_FLAGS, 0xff);
+    rfm9x_txn_update(data, txn, RH_RF95_REG_40_DIO_MAPPING1, RH_RF95_DIO0_MAPPING_RX_DONE);
+    rfm9x_txn_write(txn, RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_RXCONTINUOUS | RH_RF95_LONG_RANGE_MODE);
+}
+
+static void rfm9x_handle_tx(struct rfm9x_dev_data_t* data, struct k_work_delayable* dwork) {
+    const struct rfm9x_dev_cfg_t* const spi = data->dev->config;
+    uint8_t flags = 0;
+
+    int ret = rfm9x_read_register(&spi->bus, RH_RF95_REG_12_IRQ_FLAGS, &flags);
+
+    struct rfm9x_txn_t txn;
+    rfm9x_txn_init(&txn);
+
+    if (ret == 0 && (flags & RH_RF95_TX_DONE)) {
+        // The modem drops back to standby by itself once the packet is out.
+        if (data->rx_cb != NULL) {
+            rfm9x_rx_start(data, &txn);
+        } else {
+            rfm9x_txn_write(&txn, RH_RF95_REG_12_IRQ_FLAGS, 0xff);
+        }
+
+        // The shadow already has the new DIO mapping, so it can't be trusted if the write didn't make it.
+        ret = rfm9x_txn_execute(&spi->bus, &txn);
+
+        if (ret != 0) {
+            LOG_ERR("Register write after TX failed (err %d)", ret);
+            atomic_clear(&data->shadow_valid);
+        }
+
+        rfm9x_finish_tx(data, ret);
+
+        if (data->rx_cb != NULL && spi->dio0_gpio.port == NULL) {
+            k_work_reschedule_for_queue(&work_queue, dwork, K_MSEC(CONFIG_RFM9x_POLL_INTERVAL_MS));
+        }
+
+        return;
+    }
+
+    int64_t remaining = data->tx_deadline - k_uptime_get();
+
+    if (remaining <= 0) {
+        LOG_ERR("TX timed out (IRQ flags 0x%02x)", flags);
+        rfm9x_txn_write(&txn, RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_STDBY | RH_RF95_LONG_RANGE_MODE);
+
+        int err = rfm9x_txn_execute(&spi->bus, &txn);
+
+        if (err != 0) {
+            LOG_ERR("Register write after TX failed (err %d)", err);
+            atomic_clear(&data->shadow_valid);
+        }
+
+        rfm9x_finish_tx(data, ret != 0 ? ret : -ETIMEDOUT);
+        return;
+    }
+
+    // Without DIO0 this is the poll. With it, it was a spurious edge and this is the timeout.
+    k_work_reschedule_for_queue(&work_queue, dwork, spi->dio0_gpio.port != NULL ?
+            K_MSEC(remaining) : K_MSEC(CONFIG_RFM9x_POLL_INTERVAL_MS));
+}
+
+static void rfm9x_handle_rx(struct rfm9x_dev_data_t* data, struct k_work_delayable* dwork) {
+    const struct rfm9x_dev_cfg_t* const spi = data->dev->config;
+    // From the FIFO RX current address up to the packet RSSI in one go, which takes in the IRQ flags, the packet
+    // length and the packet SNR on the way.
+    uint8_t regs[RH_RF95_REG_1A_PKT_RSSI_VALUE - RH_RF95_REG_10_FIFO_RX_CURRENT_ADDR + 1];
+
+    int ret = rfm9x_read_burst(&spi->bus, RH_RF95_REG_10_FIFO_RX_CURRENT_ADDR, regs, sizeof(regs));
+    uint8_t flags = regs[RH_RF95_REG_12_IRQ_FLAGS - RH_RF95_REG_10_FIFO_RX_CURRENT_ADDR];
+
+    if (ret == 0 && (flags & RH_RF95_RX_DONE)) {
+        uint8_t len = regs[RH_RF95_REG_13_RX_NB_BYTES - RH_RF95_REG_10_FIFO_RX_CURRENT_ADDR];
+        struct rfm9x_txn_t txn;
+
+        rfm9x_txn_init(&txn);
+        rfm9x_txn_write(&txn, RH_RF95_REG_0D_FIFO_ADDR_PTR, regs[0]);
+        rfm9x_txn_write(&txn, RH_RF95_REG_12_IRQ_FLAGS, 0xff);
+        ret = rfm9x_txn_execute(&spi->bus, &txn);
+
+        if (flags & RH_RF95_PAYLOAD_CRC_ERROR) {
+            data->rx_crc_errors++;
+            LOG_DBG("Dropped a packet with a bad CRC, %u so far", data->rx_crc_errors);
+        } else if (ret == 0 && len > 0) {
+            ret = rfm9x_read_burst(&spi->bus, RH_RF95_REG_00_FIFO, data->rx_buf, len);
+        }
+
+        // SNR is in quarter dB. Below the noise floor the packet RSSI needs the SNR taking off to be right.
+        int8_t snr = (int8_t) regs[RH_RF95_REG_19_PKT_SNR_VALUE - RH_RF95_REG_10_FIFO_RX_CURRENT_ADDR] / 4;
+        int16_t rssi = regs[RH_RF95_REG_1A_PKT_RSSI_VALUE - RH_RF95_REG_10_FIFO_RX_CURRENT_ADDR] -
+                (data->config.frequency > LF_PORT_MAX_FREQUENCY ? RSSI_OFFSET_HF : RSSI_OFFSET_LF) +
+                MIN(snr, 0);
+        lora_recv_cb cb = data->rx_cb;
+
+        if (ret == 0 && len > 0 && !(flags & RH_RF95_PAYLOAD_CRC_ERROR) && cb != NULL) {
+            cb(data->dev, data->rx_buf, len, rssi, snr);
+        }
+    }
+
+    if (data->rx_cb != NULL && spi->dio0_gpio.port == NULL) {
+        k_work_reschedule_for_queue(&work_queue, dwork, K_MSEC(CONFIG_RFM9x_POLL_INTERVAL_MS));
+    }
+}
+
+static void rfm9x_irq_work_handler(struct k_work* work) {
+    struct k_work_delayable* dwork = k_work_delayable_from_work(work);
+    struct rfm9x_dev_data_t* data = CONTAINER_OF(dwork, struct rfm9x_dev_data_t, irq_work);
+
+    if (atomic_get(&data->tx_busy)) {
+        rfm9x_handle_tx(data, dwork);
+    } else if (data->rx_cb != NULL) {
+        rfm9x_handle_rx(data, dwork);
+    }
+}
+
+static void rfm9x_dio0_handler(const struct device* port, struct gpio_callback* cb, gpio_port_pins_t pins) {
+    ARG_UNUSED(port);
+    ARG_UNUSED(pins);
+
+    struct rfm9x_dev_data_t* data = CONTAINER_OF(cb, struct rfm9x_dev_data_t, dio0_cb);
+
+    k_work_reschedule_for_queue(&work_queue, &data->irq_work, K_NO_WAIT);
+}
+
+static int rfm9x_init_dio0(const struct device* dev) {
+    const struct rfm9x_dev_cfg_t* const spi = dev->config;
+    struct rfm9x_dev_data_t* data = dev->data;
+
+    if (spi->dio0_gpio.port == NULL) {
+        LOG_INF("No DIO0, polling for TX and RX done");
+        return 0;
+    }
+
+    if (!device_is_ready(spi->dio0_gpio.port)) {
+        LOG_ERR("DIO0 GPIO device not ready");
+        return -ENODEV;
+    }
+
+    if (gpio_pin_configure_dt(&spi->dio0_gpio, GPIO_INPUT) ||
+        gpio_pin_interrupt_configure_dt(&spi->dio0_gpio, GPIO_INT_EDGE_TO_ACTIVE)) {
+        LOG_ERR("Couldn't configure DIO0");
+        return -EIO;
+    }
+
+    gpio_init_callback(&data->dio0_cb, rfm9x_dio0_handler, BIT(spi->dio0_gpio.pin));
+
+    return gpio_add_callback(spi->dio0_gpio.port, &data->dio0_cb);
 }
 
 static int rfm9x_init(const struct device* dev) {
     const struct rfm9x_dev_cfg_t* const spi = dev->config;
+    struct rfm9x_dev_data_t* data = dev->data;
+
+    data->dev = dev;
+    k_mutex_init(&data->lock);
+    k_sem_init(&data->rx_sync.done, 0, 1);
+    k_work_init_delayable(&data->irq_work, rfm9x_irq_work_handler);
+    k_msgq_init(&data->txn_queue, data->txn_queue_buf, sizeof(struct rfm9x_txn_t), TXN_QUEUE_SIZE);
+    k_work_init(&data->txn_work, rfm9x_txn_work_handler);
+
+    // Shared by every instance, so only the first one starts it.
+    if (k_work_queue_thread_get(&work_queue) == NULL) {
+        k_work_queue_init(&work_queue);
+        k_work_queue_start(&work_queue, worker_stack_area,
+                           K_THREAD_STACK_SIZEOF(worker_stack_area), WORKER_PRIORITY,
+                           NULL);
+    }
 
     if (!spi_is_ready(&spi->bus)) {
         LOG_ERR("SPI bus not ready");
@@ -135,45 +612,85 @@ static int rfm9x_init(const struct device* dev) {
         }
     }
 
-    int ret = rfm9x_write_register(&spi->bus, RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_SLEEP | RH_RF95_LONG_RANGE_MODE);
+    struct rfm9x_txn_t txn;
+    rfm9x_txn_init(&txn);
+    rfm9x_txn_write(&txn, RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_SLEEP | RH_RF95_LONG_RANGE_MODE);
+
+    // The worker thread doesn't run until the kernel is up, so this one goes straight out.
+    int ret = rfm9x_txn_execute(&spi->bus, &txn);
     if (ret < 0) {
         LOG_ERR("SPI write failed: %i", ret);
         return ret;
     }
 
-    return 0;
+    ret = rfm9x_shadow_load(dev);
+    if (ret < 0) {
+        LOG_ERR("SPI read failed: %i", ret);
+        return ret;
+    }
+
+    return rfm9x_init_dio0(dev);
+}
+
+// A symbol longer than 16 ms needs the low data rate optimisation, which is SF11 and up at 125 kHz and SF12 at 250.
+static bool rfm9x_low_data_rate(const struct lora_modem_config* config) {
+    switch (config->bandwidth) {
+        case BW_125_KHZ:
+            return config->datarate >= SF_11;
+        case BW_250_KHZ:
+            return config->datarate >= SF_12;
+        default:
+            return false;
+    }
 }
 
 static int rfm9x_lora_config(const struct device* dev, struct lora_modem_config* config) {
-    const struct rfm9x_dev_cfg_t* const spi = dev->config;
+    struct rfm9x_dev_data_t* data = dev->data;
+
+    // SF6 only works with implicit headers, which the LoRa API has no way to ask for.
+    if (config->datarate < SF_7 || config->datarate > SF_12) {
+        return -ENOTSUP;
+    }
+
+    k_mutex_lock(&data->lock, K_FOREVER);
 
-    rfm9x_write_register(&spi->bus, RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_STDBY | RH_RF95_LONG_RANGE_MODE);
-    rfm9x_write_register(&spi->bus, RH_RF95_REG_0E_FIFO_TX_BASE_ADDR, 0);
-    rfm9x_write_register(&spi->bus, RH_RF95_REG_0F_FIFO_RX_BASE_ADDR, 0);
+    if (atomic_get(&data->tx_busy)) {
+        k_mutex_unlock(&data->lock);
+        return -EBUSY;
+    }
+
+    if (!atomic_get(&data->shadow_valid) && rfm9x_shadow_load(dev) != 0) {
+        k_mutex_unlock(&data->lock);
+        return -EIO;
+    }
+
+    uint8_t conf1 = data->shadow[RH_RF95_REG_1D_MODEM_CONFIG1];
+    uint8_t conf2 = data->shadow[RH_RF95_REG_1E_MODEM_CONFIG2];
+
+    // In address order where it doesn't matter, so the whole lot goes out in a few bursts instead of one transfer per
+    // register. Anything that's the same as last time is left out altogether.
+    struct rfm9x_txn_t txn;
+    rfm9x_txn_init(&txn);
+    rfm9x_txn_write(&txn, RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_STDBY | RH_RF95_LONG_RANGE_MODE);
 
     // Frequency
     uint32_t frf = config->frequency / RH_RF95_FSTEP;
-    rfm9x_write_register(&spi->bus, RH_RF95_REG_06_FRF_MSB, (frf >> 16) & 0xff);
-    rfm9x_write_register(&spi->bus, RH_RF95_REG_07_FRF_MID, (frf >> 8) & 0xff);
-    rfm9x_write_register(&spi->bus, RH_RF95_REG_08_FRF_LSB, frf & 0xff);
+    rfm9x_txn_update(data, &txn, RH_RF95_REG_06_FRF_MSB, (frf >> 16) & 0xff);
+    rfm9x_txn_update(data, &txn, RH_RF95_REG_07_FRF_MID, (frf >> 8) & 0xff);
+    rfm9x_txn_update(data, &txn, RH_RF95_REG_08_FRF_LSB, frf & 0xff);
 
     // Power
     int8_t power = MAX(MIN(config->tx_power, 23), 5);
+    uint8_t pa_dac = RH_RF95_PA_DAC_DISABLE;
     if (power > 20) {
-        rfm9x_write_register(&spi->bus, RH_RF95_REG_4D_PA_DAC, RH_RF95_PA_DAC_ENABLE);
+        pa_dac = RH_RF95_PA_DAC_ENABLE;
         power -= 3;
-    } else {
-        rfm9x_write_register(&spi->bus, RH_RF95_REG_4D_PA_DAC, RH_RF95_PA_DAC_DISABLE);
     }
 
-    rfm9x_write_register(&spi->bus, RH_RF95_REG_09_PA_CONFIG, RH_RF95_PA_SELECT | (power - 5));
-
-    // Preamble length
-    rfm9x_write_register(&spi->bus, RH_RF95_REG_20_PREAMBLE_MSB, config->preamble_len >> 8);
-    rfm9x_write_register(&spi->bus, RH_RF95_REG_21_PREAMBLE_LSB, config->preamble_len & 0xff);
+    rfm9x_txn_update(data, &txn, RH_RF95_REG_09_PA_CONFIG, RH_RF95_PA_SELECT | (power - 5));
 
-    uint8_t conf1;
-    rfm9x_read_register(&spi->bus, RH_RF95_REG_1D_MODEM_CONFIG1, &conf1);
+    rfm9x_txn_update(data, &txn, RH_RF95_REG_0E_FIFO_TX_BASE_ADDR, 0);
+    rfm9x_txn_update(data, &txn, RH_RF95_REG_0F_FIFO_RX_BASE_ADDR, 0);
 
     // Bandwidth
     switch (config->bandwidth) {
@@ -191,27 +708,218 @@ static int rfm9x_lora_config(const struct device* dev, struct lora_modem_config*
     // Coding rate
     uint8_t cr = config->coding_rate << 1;
     conf1 = (conf1 & ~RH_RF95_CODING_RATE) | cr;
+    rfm9x_txn_update(data, &txn, RH_RF95_REG_1D_MODEM_CONFIG1, conf1);
 
-    // Datarate
-    conf1 = (conf1 & ~RH_RF95_SPREADING_FACTOR) | (config->datarate << 4);
+    // Datarate. The spreading factor is in the top of config 2, not config 1 where it used to overwrite the bandwidth.
+    conf2 = (conf2 & ~RH_RF95_SPREADING_FACTOR) | (config->datarate << 4) | RH_RF95_PAYLOAD_CRC_ON;
+    rfm9x_txn_update(data, &txn, RH_RF95_REG_1E_MODEM_CONFIG2, conf2);
 
-    rfm9x_write_register(&spi->bus, RH_RF95_REG_1D_MODEM_CONFIG1, conf1);
+    // Preamble length
+    rfm9x_txn_update(data, &txn, RH_RF95_REG_20_PREAMBLE_MSB, config->preamble_len >> 8);
+    rfm9x_txn_update(data, &txn, RH_RF95_REG_21_PREAMBLE_LSB, config->preamble_len & 0xff);
 
-    uint8_t conf2;
-    rfm9x_read_register(&spi->bus, RH_RF95_REG_1D_MODEM_CONFIG1, &conf2);
-    LOG_DBG("Expected: %x got %x", conf1, conf2);
+    rfm9x_txn_update(data, &txn, RH_RF95_REG_26_MODEM_CONFIG3,
+                     RH_RF95_AGC_AUTO_ON | (rfm9x_low_data_rate(config) ? RH_RF95_LOW_DATA_RATE_OPTIMIZE : 0));
+    rfm9x_txn_update(data, &txn, RH_RF95_REG_4D_PA_DAC, pa_dac);
 
-    // TX/RX mode
-    uint8_t opmode;
-    rfm9x_read_register(&spi->bus, RH_RF95_REG_01_OP_MODE, &opmode);
+    // Transmitting starts with each packet, so a TX config leaves the modem in standby until then.
+    if (!config->tx) {
+        rfm9x_txn_write(&txn, RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_RXCONTINUOUS | RH_RF95_LONG_RANGE_MODE);
+    }
 
-    if (config->tx) {
-        opmode = (opmode & ~RH_RF95_MODE) | RH_RF95_MODE_TX;
-    } else {
-        opmode = (opmode & ~RH_RF95_MODE) | RH_RF95_MODE_RXCONTINUOUS;
+    int ret = rfm9x_txn_submit_and_wait(dev, &txn);
+    if (ret != 0) {
+        LOG_ERR("Couldn't configure the modem (err %d)", ret);
+        k_mutex_unlock(&data->lock);
+        return ret;
     }
 
-    rfm9x_write_register(&spi->bus, RH_RF95_REG_01_OP_MODE, opmode);
+    data->config = *config;
+    k_mutex_unlock(&data->lock);
 
     return 0;
 }
+
+// The deadline runs from when the modem actually starts, not from when the packet was queued.
+static void rfm9x_tx_started(const struct device* dev, int result, void* user_data) {
+    ARG_UNUSED(user_data);
+
+    const struct rfm9x_dev_cfg_t* const spi = dev->config;
+    struct rfm9x_dev_data_t* data = dev->data;
+
+    if (result != 0) {
+        LOG_ERR("Couldn't start TX (err %d)", result);
+        rfm9x_finish_tx(data, result);
+        return;
+    }
+
+    data->tx_deadline = k_uptime_get() + CONFIG_RFM9x_TX_TIMEOUT_MS;
+    k_work_reschedule_for_queue(&work_queue, &data->irq_work, spi->dio0_gpio.port != NULL ?
+            K_MSEC(CONFIG_RFM9x_TX_TIMEOUT_MS) : K_MSEC(CONFIG_RFM9x_POLL_INTERVAL_MS));
+}
+
+// Exactly one of wait and async is set.
+static int rfm9x_start_tx(const struct device* dev, const uint8_t* buf, uint32_t len, struct rfm9x_txn_wait_t* wait,
+                          struct k_poll_signal* async) {
+    const struct rfm9x_dev_cfg_t* const spi = dev->config;
+    struct rfm9x_dev_data_t* data = dev->data;
+
+    if (len == 0 || len > RH_RF95_MAX_PAYLOAD_LEN) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&data->lock, K_FOREVER);
+
+    if (!atomic_cas(&data->tx_busy, 0, 1)) {
+        k_mutex_unlock(&data->lock);
+        return -EBUSY;
+    }
+
+    data->tx_wait = wait;
+    data->tx_signal = async;
+
+    // The whole payload goes into the FIFO in one burst from the TX base address, then the modem is set going.
+    struct rfm9x_txn_t txn;
+    rfm9x_txn_init(&txn);
+    rfm9x_txn_write(&txn, RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_STDBY | RH_RF95_LONG_RANGE_MODE);
+    rfm9x_txn_write(&txn, RH_RF95_REG_0D_FIFO_ADDR_PTR, 0);
+    rfm9x_txn_write_fifo(&txn, buf, len);
+    rfm9x_txn_write(&txn, RH_RF95_REG_12_IRQ_FLAGS, 0xff);
+    rfm9x_txn_write(&txn, RH_RF95_REG_22_PAYLOAD_LENGTH, len);
+    rfm9x_txn_update(data, &txn, RH_RF95_REG_40_DIO_MAPPING1, RH_RF95_DIO0_MAPPING_TX_DONE);
+    rfm9x_txn_write(&txn, RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_TX | RH_RF95_LONG_RANGE_MODE);
+    txn.callback = rfm9x_tx_started;
+
+    int ret = rfm9x_txn_submit(dev, &txn);
+
+    if (ret != 0) {
+        LOG_ERR("Couldn't start TX (err %d)", ret);
+        data->tx_wait = NULL;
+        data->tx_signal = NULL;
+        atomic_set(&data->tx_busy, 0);
+    }
+
+    k_mutex_unlock(&data->lock);
+
+    return ret;
+}
+
+static int rfm9x_lora_send(const struct device* dev, uint8_t* data, uint32_t data_len) {
+    struct rfm9x_txn_wait_t wait = {.result = 0};
+
+    k_sem_init(&wait.done, 0, 1);
+
+    int ret = rfm9x_start_tx(dev, data, data_len, &wait, NULL);
+    if (ret != 0) {
+        return ret;
+    }
+
+    // The IRQ work always finishes a transmission one way or the other, by the timeout at the latest.
+    k_sem_take(&wait.done, K_FOREVER);
+
+    return wait.result;
+}
+
+// The payload is copied into the queued transaction, so the buffer is free straight away.
+static int rfm9x_lora_send_async(const struct device* dev, uint8_t* data, uint32_t data_len,
+                                 struct k_poll_signal* async) {
+    if (async == NULL) {
+        return -EINVAL;
+    }
+
+    return rfm9x_start_tx(dev, data, data_len, NULL, async);
+}
+
+// Passing NULL stops receiving and leaves the modem in standby.
+static int rfm9x_lora_recv_async(const struct device* dev, lora_recv_cb cb) {
+    const struct rfm9x_dev_cfg_t* const spi = dev->config;
+    struct rfm9x_dev_data_t* data = dev->data;
+
+    k_mutex_lock(&data->lock, K_FOREVER);
+
+    if (atomic_get(&data->tx_busy)) {
+        k_mutex_unlock(&data->lock);
+        return -EBUSY;
+    }
+
+    struct rfm9x_txn_t txn;
+    rfm9x_txn_init(&txn);
+
+    // Set before the modem starts listening so the first packet isn't missed.
+    data->rx_cb = cb;
+
+    if (cb != NULL) {
+        rfm9x_rx_start(data, &txn);
+    } else {
+        rfm9x_txn_write(&txn, RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_STDBY | RH_RF95_LONG_RANGE_MODE);
+    }
+
+    int ret = rfm9x_txn_submit_and_wait(dev, &txn);
+
+    if (ret != 0) {
+        data->rx_cb = NULL;
+    } else if (cb != NULL && spi->dio0_gpio.port == NULL) {
+        k_work_reschedule_for_queue(&work_queue, &data->irq_work, K_MSEC(CONFIG_RFM9x_POLL_INTERVAL_MS));
+    }
+
+    k_mutex_unlock(&data->lock);
+
+    return ret;
+}
+
+static void rfm9x_recv_sync_cb(const struct device* dev, uint8_t* buf, uint16_t size, int16_t rssi, int8_t snr) {
+    struct rfm9x_dev_data_t* data = dev->data;
+    k_spinlock_key_t key = k_spin_lock(&data->rx_sync.lock);
+
+    // Only the first packet, anything after it and before receiving stops is dropped, as is anything after lora_recv
+    // has given up.
+    if (data->rx_sync.data != NULL && k_sem_count_get(&data->rx_sync.done) == 0) {
+        data->rx_sync.len = MIN(size, data->rx_sync.size);
+        memcpy(data->rx_sync.data, buf, data->rx_sync.len);
+        data->rx_sync.rssi = rssi;
+        data->rx_sync.snr = snr;
+        k_sem_give(&data->rx_sync.done);
+    }
+
+    k_spin_unlock(&data->rx_sync.lock, key);
+}
+
+static int rfm9x_lora_recv(const struct device* dev, uint8_t* data, uint8_t size, k_timeout_t timeout, int16_t* rssi,
+                           int8_t* snr) {
+    struct rfm9x_dev_data_t* dev_data = dev->data;
+    k_spinlock_key_t key = k_spin_lock(&dev_data->rx_sync.lock);
+
+    dev_data->rx_sync.data = data;
+    dev_data->rx_sync.size = size;
+    k_sem_reset(&dev_data->rx_sync.done);
+    k_spin_unlock(&dev_data->rx_sync.lock, key);
+
+    int ret = rfm9x_lora_recv_async(dev, rfm9x_recv_sync_cb);
+    if (ret != 0) {
+        return ret;
+    }
+
+    ret = k_sem_take(&dev_data->rx_sync.done, timeout);
+
+    // The caller's buffer is theirs again once this returns, even if the worker is already on its way to the callback.
+    key = k_spin_lock(&dev_data->rx_sync.lock);
+    dev_data->rx_sync.data = NULL;
+    dev_data->rx_sync.size = 0;
+    k_spin_unlock(&dev_data->rx_sync.lock, key);
+
+    rfm9x_lora_recv_async(dev, NULL);
+
+    if (ret != 0) {
+        return -EAGAIN;
+    }
+
+    if (rssi != NULL) {
+        *rssi = dev_data->rx_sync.rssi;
+    }
+
+    if (snr != NULL) {
+        *snr = dev_data->rx_sync.snr;
+    }
+
+    return dev_data->rx_sync.len;
+}
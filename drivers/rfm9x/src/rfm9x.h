@@ -213,6 +213,15 @@
 #define RH_RF95_PAYLOAD_CRC_ON                        0x04
 #define RH_RF95_SYM_TIMEOUT_MSB                       0x03
 
+// RH_RF95_REG_26_MODEM_CONFIG3                       0x26
+#define RH_RF95_LOW_DATA_RATE_OPTIMIZE                0x08
+#define RH_RF95_AGC_AUTO_ON                           0x04
+
+// RH_RF95_REG_40_DIO_MAPPING1                        0x40
+#define RH_RF95_DIO0_MAPPING                          0xc0
+#define RH_RF95_DIO0_MAPPING_RX_DONE                  0x00
+#define RH_RF95_DIO0_MAPPING_TX_DONE                  0x40
+
 // RH_RF95_REG_4B_TCXO                                0x4b
 #define RH_RF95_TCXO_TCXO_INPUT_ON                    0x10
 
@@ -4,11 +4,39 @@
 #include <zephyr/kernel.h>
 
 struct config_t {
+    // Where the base station's survey mark is, in degrees and metres above the WGS84 ellipsoid. All zeros until it
+    // has been surveyed in or set by hand.
     double latitude;
     double longitude;
     float elevation;
+    // Metres from the mark up to the antenna's phase centre.
     float antenna_height;
+    // Seconds between NMEA sentences, or 0 for every position update. The receiver counts it in position updates, in a
+    // byte, so sample_interval * update_rate can't be more than 255.
     uint8_t sample_interval;
+    // enum output_mode_t. New fields go on the end so configurations saved before they existed still load.
+    uint8_t output_mode;
+    // Position updates per second: 1, 2, 4, 5, 8, 10 or 20.
+    uint8_t update_rate;
+    // enum role_t.
+    uint8_t role;
 };
 
+enum output_mode_t {
+    OUTPUT_MODE_NMEA,
+    // SkyTraq binary navigation data and raw measurements, decoded on the device.
+    OUTPUT_MODE_BINARY
+};
+
+enum role_t {
+    // Surveys itself in if it has to, and sends corrections over LoRa.
+    ROLE_BASE,
+    // Receives corrections over LoRa and passes them to the receiver.
+    ROLE_ROVER
+};
+
+static inline bool config_has_base_position(const struct config_t* config) {
+    return config->latitude != 0.0 || config->longitude != 0.0;
+}
+
 #endif //DIY_GNSS_V2_CONFIG_H
@@ -0,0 +1,24 @@
+#ifndef _CORRECTION_EVENT_H_
+#define _CORRECTION_EVENT_H_
+
+#include <app_event_manager.h>
+#include <zephyr/net/buf.h>
+
+// An RTCM 3 frame from the base, put back together from LoRa packets on a rover.
+struct correction_event {
+    struct app_event_header header;
+
+    // Referenced the same way as gnss_event's buf.
+    struct net_buf* buf;
+    uint16_t size;
+    uint16_t msg_type;
+    // k_uptime_get_32() when the packet that finished the frame arrived, and how well that packet was received, in dBm
+    // and dB.
+    uint32_t received_ms;
+    int16_t rssi;
+    int8_t snr;
+};
+
+APP_EVENT_TYPE_DECLARE(correction_event);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef _EPOCH_EVENT_H_
+#define _EPOCH_EVENT_H_
+
+#include "px1122r.h"
+
+#include <app_event_manager.h>
+#include <zephyr/net/buf.h>
+
+// Everything the receiver sent for one epoch, back to back in one buffer chain. Binary messages have no epoch to
+// speak of, so they each get an epoch_event of their own.
+struct epoch_event {
+    struct app_event_header header;
+
+    // Referenced the same way as gnss_event's buf.
+    struct net_buf* buf;
+    uint16_t size;
+    uint8_t messages;
+    // From the epoch's first message, so latency measured from here includes the wait for the rest.
+    uint32_t timestamp;
+    struct px1122r_pps_edge_t pps;
+};
+
+APP_EVENT_TYPE_DECLARE(epoch_event);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef _FIX_EVENT_H_
+#define _FIX_EVENT_H_
+
+#include "px1122r.h"
+
+#include <app_event_manager.h>
+
+// A decoded position fix, one per epoch, whichever output mode the receiver is in.
+struct fix_event {
+    struct app_event_header header;
+
+    struct px1122r_fix_t fix;
+    // Same as the gnss_event fields of the same names.
+    uint32_t timestamp;
+    struct px1122r_pps_edge_t pps;
+};
+
+APP_EVENT_TYPE_DECLARE(fix_event);
+
+#endif
@@ -1,15 +1,55 @@
 #ifndef _GNSS_EVENT_H_
 #define _GNSS_EVENT_H_
 
+#include "px1122r.h"
+
 #include <app_event_manager.h>
+#include <zephyr/net/buf.h>
 
 struct gnss_event {
         struct app_event_header header;
 
-        int8_t* bytes;
+        // The message, in one pool buffer or a chain of them for long ones. The event holds a reference that's
+        // dropped once every listener has seen it, so a listener that needs the data afterwards takes its own with
+        // gnss_buf_ref() and drops it with gnss_buf_unref() when it's done.
+        struct net_buf* buf;
+        // Total length across the whole chain.
         uint16_t size;
+        enum px1122r_msg_type_t type;
+        // RTCM 3 message number, so sinks can pick the messages they want without parsing the frame.
+        uint16_t rtcm3_msg_type;
+        // k_cycle_get_32() when the message came off the UART.
+        uint32_t timestamp;
+        // The 1PPS edge marking the start of the second this message's epoch falls in. sequence is 0 without one.
+        struct px1122r_pps_edge_t pps;
+};
+
+struct gnss_buf_stats_t {
+        uint16_t in_use;
+        uint16_t high_water;
+        uint16_t count;
+        uint32_t alloc_failures;
 };
 
+// net_buf_ref() and net_buf_unref() for buffers from the gnss_event pool. They're shared between threads and
+// net_buf's own reference count isn't atomic, so never use those directly on them.
+struct net_buf* gnss_buf_ref(struct net_buf* buf);
+void gnss_buf_unref(struct net_buf* buf);
+
+// Copies a message into a chain of buffers from the gnss_event pool. Returns NULL if there aren't enough free, in
+// which case nothing is taken from the pool.
+struct net_buf* gnss_buf_alloc(const uint8_t* data, size_t len);
+
+// Copies len bytes onto the end of the chain at *head, starting a chain if *head is NULL. On failure -ENOMEM is
+// returned and the chain may have been partly extended.
+int gnss_buf_append_mem(struct net_buf** head, const uint8_t* data, size_t len);
+
+// Copies src onto the end of the chain at *head, starting a chain if *head is NULL. On failure -ENOMEM is returned
+// and the chain may have been partly extended.
+int gnss_buf_append(struct net_buf** head, const struct net_buf* src);
+
+void gnss_buf_get_stats(struct gnss_buf_stats_t* stats);
+
 APP_EVENT_TYPE_DECLARE(gnss_event);
 
 #endif
@@ -0,0 +1,37 @@
+#ifndef _LINK_EVENT_H_
+#define _LINK_EVENT_H_
+
+#include <app_event_manager.h>
+
+// How important a message is to whoever is on the other end of the link. Under congestion the least important go
+// first, and critical ones are never shed.
+enum stream_priority_t {
+    STREAM_PRIORITY_LOW,
+    STREAM_PRIORITY_MEDIUM,
+    STREAM_PRIORITY_HIGH,
+    STREAM_PRIORITY_CRITICAL
+};
+
+// Sent by io_module whenever its outbound queue crosses a watermark or the link's notification size changes, and every
+// few seconds regardless.
+struct link_event {
+    struct app_event_header header;
+
+    // Messages below this priority should be dropped before they're queued. STREAM_PRIORITY_LOW means keep
+    // everything.
+    enum stream_priority_t shed_below;
+    // Set when this event closes a measurement window. Those sent straight away for a shed level change carry the
+    // last full window's figures again.
+    bool window_end;
+    // Over the last measurement window: the percentage of the time the sender was busy sending or waiting for the
+    // link, and bytes dropped because they didn't fit in the queue or the link stalled.
+    uint8_t utilisation;
+    uint32_t dropped;
+    // Bytes in each BLE notification, going by the MTU and link layer length the phone agreed to. 0 while nothing is
+    // connected.
+    uint16_t notification_size;
+};
+
+APP_EVENT_TYPE_DECLARE(link_event);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef _SURVEY_EVENT_H_
+#define _SURVEY_EVENT_H_
+
+#include <app_event_manager.h>
+
+// The result of a survey-in: the mean position of the antenna's phase centre.
+struct survey_event {
+    struct app_event_header header;
+
+    // Degrees.
+    double latitude;
+    double longitude;
+    // Metres above the WGS84 ellipsoid.
+    float height;
+    // 3D standard deviation of the fixes that went into it, in metres.
+    float std_dev;
+    uint32_t samples;
+    uint32_t duration_s;
+};
+
+APP_EVENT_TYPE_DECLARE(survey_event);
+
+#endif
@@ -0,0 +1,26 @@
+#include "events/correction_event.h"
+#include "events/gnss_event.h"
+
+static void log_correction_event(const struct app_event_header* aeh) {
+    struct correction_event* event = cast_correction_event(aeh);
+
+    APP_EVENT_MANAGER_LOG(aeh, "msg_type=%d len=%d rssi=%d snr=%d", event->msg_type, event->size, event->rssi,
+                          event->snr);
+}
+
+static void correction_event_postprocess(const struct app_event_header* aeh) {
+    if (is_correction_event(aeh)) {
+        struct correction_event* event = cast_correction_event(aeh);
+
+        if (event->buf != NULL) {
+            gnss_buf_unref(event->buf);
+        }
+    }
+}
+
+APP_EVENT_HOOK_POSTPROCESS_REGISTER_LAST(correction_event_postprocess);
+
+APP_EVENT_TYPE_DEFINE(correction_event,
+        log_correction_event,
+        NULL,
+        APP_EVENT_FLAGS_CREATE(APP_EVENT_TYPE_FLAGS_INIT_LOG_ENABLE));
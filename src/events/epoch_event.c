@@ -0,0 +1,25 @@
+#include "events/epoch_event.h"
+#include "events/gnss_event.h"
+
+static void log_epoch_event(const struct app_event_header* aeh) {
+    struct epoch_event* event = cast_epoch_event(aeh);
+
+    APP_EVENT_MANAGER_LOG(aeh, "messages=%d len=%d", event->messages, event->size);
+}
+
+static void epoch_event_postprocess(const struct app_event_header* aeh) {
+    if (is_epoch_event(aeh)) {
+        struct epoch_event* event = cast_epoch_event(aeh);
+
+        if (event->buf != NULL) {
+            gnss_buf_unref(event->buf);
+        }
+    }
+}
+
+APP_EVENT_HOOK_POSTPROCESS_REGISTER_LAST(epoch_event_postprocess);
+
+APP_EVENT_TYPE_DEFINE(epoch_event,
+        log_epoch_event,
+        NULL,
+        APP_EVENT_FLAGS_CREATE(APP_EVENT_TYPE_FLAGS_INIT_LOG_ENABLE));
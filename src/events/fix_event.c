@@ -0,0 +1,13 @@
+#include "events/fix_event.h"
+
+static void log_fix_event(const struct app_event_header* aeh) {
+    struct fix_event* event = cast_fix_event(aeh);
+
+    APP_EVENT_MANAGER_LOG(aeh, "quality=%d sv=%d lat=%d lon=%d", event->fix.quality, event->fix.num_sv,
+                          event->fix.latitude, event->fix.longitude);
+}
+
+APP_EVENT_TYPE_DEFINE(fix_event,
+        log_fix_event,
+        NULL,
+        APP_EVENT_FLAGS_CREATE(APP_EVENT_TYPE_FLAGS_INIT_LOG_ENABLE));
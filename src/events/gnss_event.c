@@ -1,11 +1,138 @@
 #include "events/gnss_event.h"
 
+// Most NMEA sentences fit in one buffer. Longer messages, like raw measurements or big RTCM frames, take a chain.
+#define GNSS_BUF_SIZE 128
+// Room for a couple of epochs in flight as separate messages, and again as aggregated epochs.
+#define GNSS_BUF_COUNT 64
+
+static void gnss_buf_destroy(struct net_buf* buf);
+
+NET_BUF_POOL_FIXED_DEFINE(gnss_buf_pool, GNSS_BUF_COUNT, GNSS_BUF_SIZE, 0, gnss_buf_destroy);
+
+// net_buf's reference count is a plain uint8_t, and these buffers are ref'd and unref'd from the system work queue,
+// the io and LoRa work queues and the PX1122R driver's. Every ref and unref goes through this lock.
+static struct k_spinlock ref_lock;
+
+static atomic_t bufs_in_use;
+static atomic_t bufs_high_water;
+static atomic_t alloc_failures;
+
+static void gnss_buf_destroy(struct net_buf* buf) {
+    atomic_dec(&bufs_in_use);
+    net_buf_destroy(buf);
+}
+
+static struct net_buf* gnss_buf_alloc_one(void) {
+    struct net_buf* buf = net_buf_alloc(&gnss_buf_pool, K_NO_WAIT);
+
+    if (buf == NULL) {
+        atomic_inc(&alloc_failures);
+        return NULL;
+    }
+
+    atomic_val_t in_use = atomic_inc(&bufs_in_use) + 1;
+    atomic_val_t high_water = atomic_get(&bufs_high_water);
+
+    while (in_use > high_water && !atomic_cas(&bufs_high_water, high_water, in_use)) {
+        high_water = atomic_get(&bufs_high_water);
+    }
+
+    return buf;
+}
+
+struct net_buf* gnss_buf_ref(struct net_buf* buf) {
+    k_spinlock_key_t key = k_spin_lock(&ref_lock);
+
+    net_buf_ref(buf);
+    k_spin_unlock(&ref_lock, key);
+
+    return buf;
+}
+
+void gnss_buf_unref(struct net_buf* buf) {
+    k_spinlock_key_t key = k_spin_lock(&ref_lock);
+
+    net_buf_unref(buf);
+    k_spin_unlock(&ref_lock, key);
+}
+
+// Fills whatever room is left in the last buffer of the chain before adding more.
+int gnss_buf_append_mem(struct net_buf** head, const uint8_t* data, size_t len) {
+    while (len > 0) {
+        struct net_buf* tail = *head != NULL ? net_buf_frag_last(*head) : NULL;
+
+        if (tail == NULL || net_buf_tailroom(tail) == 0) {
+            tail = gnss_buf_alloc_one();
+
+            if (tail == NULL) {
+                return -ENOMEM;
+            }
+
+            *head = net_buf_frag_add(*head, tail);
+        }
+
+        size_t n = MIN(len, net_buf_tailroom(tail));
+
+        net_buf_add_mem(tail, data, n);
+        data += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+struct net_buf* gnss_buf_alloc(const uint8_t* data, size_t len) {
+    struct net_buf* head = NULL;
+
+    if (gnss_buf_append_mem(&head, data, len) != 0) {
+        if (head != NULL) {
+            gnss_buf_unref(head);
+        }
+
+        return NULL;
+    }
+
+    return head;
+}
+
+int gnss_buf_append(struct net_buf** head, const struct net_buf* src) {
+    for (; src != NULL; src = src->frags) {
+        int err = gnss_buf_append_mem(head, src->data, src->len);
+
+        if (err != 0) {
+            return err;
+        }
+    }
+
+    return 0;
+}
+
+void gnss_buf_get_stats(struct gnss_buf_stats_t* stats) {
+    stats->in_use = atomic_get(&bufs_in_use);
+    stats->high_water = atomic_get(&bufs_high_water);
+    stats->count = GNSS_BUF_COUNT;
+    stats->alloc_failures = atomic_get(&alloc_failures);
+}
+
 static void log_gnss_event(const struct app_event_header* hdr) {
     struct gnss_event *event = cast_gnss_event(hdr);
 
-    APP_EVENT_MANAGER_LOG(hdr, "buf=%p len=%d", (void*)event->bytes, event->size);
+    APP_EVENT_MANAGER_LOG(hdr, "type=%d buf=%p len=%d", event->type, (void*)event->buf, event->size);
 }
 
+// Runs after every listener has had the event, so this drops the event's own reference last.
+static void gnss_event_postprocess(const struct app_event_header* aeh) {
+    if (is_gnss_event(aeh)) {
+        struct gnss_event* event = cast_gnss_event(aeh);
+
+        if (event->buf != NULL) {
+            gnss_buf_unref(event->buf);
+        }
+    }
+}
+
+APP_EVENT_HOOK_POSTPROCESS_REGISTER_LAST(gnss_event_postprocess);
+
 APP_EVENT_TYPE_DEFINE(gnss_event,
                       log_gnss_event,
                       NULL,
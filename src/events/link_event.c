@@ -0,0 +1,14 @@
+#include "events/link_event.h"
+
+static void log_link_event(const struct app_event_header* aeh) {
+    struct link_event* event = cast_link_event(aeh);
+
+    APP_EVENT_MANAGER_LOG(aeh, "shed_below=%d window_end=%d utilisation=%d%% dropped=%u notification_size=%u",
+                          event->shed_below, event->window_end, event->utilisation, event->dropped,
+                          event->notification_size);
+}
+
+APP_EVENT_TYPE_DEFINE(link_event,
+        log_link_event,
+        NULL,
+        APP_EVENT_FLAGS_CREATE(APP_EVENT_TYPE_FLAGS_INIT_LOG_ENABLE));
@@ -0,0 +1,13 @@
+#include "events/survey_event.h"
+
+static void log_survey_event(const struct app_event_header* aeh) {
+    struct survey_event* event = cast_survey_event(aeh);
+
+    APP_EVENT_MANAGER_LOG(aeh, "lat=%f lon=%f h=%f sd=%f n=%d", event->latitude, event->longitude,
+                          (double)event->height, (double)event->std_dev, event->samples);
+}
+
+APP_EVENT_TYPE_DEFINE(survey_event,
+        log_survey_event,
+        NULL,
+        APP_EVENT_FLAGS_CREATE(APP_EVENT_TYPE_FLAGS_INIT_LOG_ENABLE));
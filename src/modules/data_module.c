@@ -1,6 +1,7 @@
 #define MODULE data_module
 
 #include "events/data_event.h"
+#include "events/survey_event.h"
 #include "config.h"
 
 #include <caf/events/module_state_event.h>
@@ -22,18 +23,23 @@ static int load_config(const char*, size_t, settings_read_cb, void*);
 
 static bool save_config(struct config_t);
 
+static bool valid_update_rate(uint8_t);
+static bool valid_sample_interval(uint8_t interval, uint8_t rate);
+
 static bool app_event_handler(const struct app_event_header*);
 
 static int get_data(struct bt_data*, const struct bt_le_adv_prov_adv_state*, struct bt_le_adv_prov_feedback*);
 
 static struct bt_data BT_UUID_ADV = BT_DATA_BYTES(BT_DATA_UUID128_SOME, BT_UUID_128_ENCODE(0xc33a0000, 0xbda8, 0x4293, 0xb836, 0x10dd6d78e7a1));
 
-static struct config_t config = {.latitude = 0.0, .longitude = 0.0, .elevation = 0.0f, .antenna_height = 0.0f, .sample_interval = 30};
+static struct config_t config = {.latitude = 0.0, .longitude = 0.0, .elevation = 0.0f, .antenna_height = 0.0f, .sample_interval = 30,
+                                .output_mode = OUTPUT_MODE_NMEA, .update_rate = 1, .role = ROLE_BASE};
 
 SETTINGS_STATIC_HANDLER_DEFINE(MODULE, DEVICE_SETTINGS_KEY, NULL, load_config, NULL, NULL);
 
 APP_EVENT_LISTENER(MODULE, app_event_handler);
 APP_EVENT_SUBSCRIBE(MODULE, module_state_event);
+APP_EVENT_SUBSCRIBE(MODULE, survey_event);
 
 BT_GATT_SERVICE_DEFINE(svc,
                        BT_GATT_PRIMARY_SERVICE(BT_UUID_GNSS),
@@ -106,24 +112,66 @@ static int load_config(const char* name, size_t len, settings_read_cb read_cb, v
             LOG_DBG("Device configuration loaded from flash");
             err = 0;
         }
+
+        // Configurations saved by older firmware have padding where the newer fields are.
+        if (config.output_mode > OUTPUT_MODE_BINARY) {
+            config.output_mode = OUTPUT_MODE_NMEA;
+        }
+
+        if (!valid_update_rate(config.update_rate)) {
+            config.update_rate = 1;
+        }
+
+        if (!valid_sample_interval(config.sample_interval, config.update_rate)) {
+            LOG_WRN("Sample interval %d s is too long at %d Hz", config.sample_interval, config.update_rate);
+            config.sample_interval = UINT8_MAX / config.update_rate;
+        }
+
+        if (config.role > ROLE_ROVER) {
+            config.role = ROLE_BASE;
+        }
     }
 
     return err;
 }
 
+static bool valid_update_rate(uint8_t rate) {
+    switch (rate) {
+        case 1:
+        case 2:
+        case 4:
+        case 5:
+        case 8:
+        case 10:
+        case 20:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool valid_sample_interval(uint8_t interval, uint8_t rate) {
+    return interval * rate <= UINT8_MAX;
+}
+
 static bool save_config(struct config_t cfg) {
     if (cfg.latitude < -90.0 || cfg.latitude > 90.0 ||
         cfg.longitude < -180.0 || cfg.longitude > 180.0 ||
         cfg.elevation < -10000.0f || cfg.elevation > 9000.0f ||
         cfg.antenna_height < 0.0f ||
-        cfg.sample_interval < 1) {
+        cfg.output_mode > OUTPUT_MODE_BINARY ||
+        !valid_update_rate(cfg.update_rate) ||
+        !valid_sample_interval(cfg.sample_interval, cfg.update_rate) ||
+        cfg.role > ROLE_ROVER) {
         return false;
     }
 
     settings_save_one(DEVICE_SETTINGS_KEY"/"DEVICE_SETTINGS_CONFIG_KEY, &cfg, sizeof(struct config_t));
+    config = cfg;
 
     struct data_event* config_event = new_data_event();
     config_event->config = config;
+    config_event->event_type = DATA_EVENT_CONFIG_UPDATE;
     APP_EVENT_SUBMIT(config_event);
 
     return true;
@@ -147,7 +195,26 @@ static int init_settings() {
     return 0;
 }
 
+// The survey gives the antenna's position, and the mark is the antenna height below it.
+static bool handle_survey_event(const struct survey_event* event) {
+    struct config_t cfg = config;
+
+    cfg.latitude = event->latitude;
+    cfg.longitude = event->longitude;
+    cfg.elevation = event->height - config.antenna_height;
+
+    if (!save_config(cfg)) {
+        LOG_ERR("Surveyed position %f, %f is out of range", event->latitude, event->longitude);
+    }
+
+    return false;
+}
+
 static bool app_event_handler(const struct app_event_header* aeh) {
+    if (is_survey_event(aeh)) {
+        return handle_survey_event(cast_survey_event(aeh));
+    }
+
     if (is_module_state_event(aeh)) {
         struct module_state_event* event = cast_module_state_event(aeh);
 
@@ -161,11 +228,12 @@ static bool app_event_handler(const struct app_event_header* aeh) {
 
             module_set_state(MODULE_STATE_READY);
 
-
-//            struct data_event* config_event = new_data_event();
-//            config_event->config = config;
-//            config_event->event_type = DATA_EVENT_CONFIG_INITIAL;
-//            APP_EVENT_SUBMIT(config_event);
+            // Everyone needs the config at boot. A base with no position starts surveying on it, and a rover can't wait
+            // for a config write to start listening.
+            struct data_event* config_event = new_data_event();
+            config_event->config = config;
+            config_event->event_type = DATA_EVENT_CONFIG_INITIAL;
+            APP_EVENT_SUBMIT(config_event);
         }
     }
 
@@ -0,0 +1,321 @@
+#define MODULE epoch
+
+#include "events/gnss_event.h"
+#include "events/epoch_event.h"
+#include "events/link_event.h"
+
+#include <caf/events/module_state_event.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+LOG_MODULE_REGISTER(MODULE, LOG_LEVEL_DBG);
+
+// The last sentence gnss_module's interval command turns on, so an epoch can go as soon as it arrives rather than
+// waiting for the next one to start. Set to NULL to rely on the time tag alone.
+#define EPOCH_LAST_SENTENCE "GST"
+// An epoch is sent early rather than grown past this, or past the whole number of notifications it fits in once the
+// link's notification size is known.
+#define EPOCH_MAX_SIZE 2048
+// If the stream stops mid-epoch, this is how long we hang on to what we have.
+#define EPOCH_TIMEOUT_MS 200
+// "hhmmss.sss", with room for receivers that give more decimals.
+#define TIME_TAG_MAX_LEN 12
+
+static struct {
+    struct net_buf* buf;
+    uint16_t size;
+    uint8_t messages;
+    uint32_t timestamp;
+    struct px1122r_pps_edge_t pps;
+    char time_tag[TIME_TAG_MAX_LEN];
+    uint8_t time_tag_len;
+} epoch;
+
+static uint32_t dropped_epochs;
+
+// From io_module, so a batch never spills a few bytes into a notification of its own.
+static uint16_t batch_max_size = EPOCH_MAX_SIZE;
+
+// Set by io_module when its queue backs up. Anything less important than this never makes it into an epoch.
+static enum stream_priority_t shed_below = STREAM_PRIORITY_LOW;
+static uint32_t shed_messages;
+
+struct nmea_priority_t {
+    const char* id;
+    enum stream_priority_t priority;
+};
+
+// Position and time, then what says how good they are, then the satellite detail. Anything not listed is medium.
+static const struct nmea_priority_t nmea_priorities[] = {
+        {"GGA", STREAM_PRIORITY_CRITICAL},
+        {"RMC", STREAM_PRIORITY_CRITICAL},
+        {"GST", STREAM_PRIORITY_HIGH},
+        {"GNS", STREAM_PRIORITY_HIGH},
+        {"GSA", STREAM_PRIORITY_MEDIUM},
+        {"GSV", STREAM_PRIORITY_LOW},
+};
+
+// The PSTI sentences gnss_module turns on, by their three digit ID. 030 has the RTK status.
+static const struct nmea_priority_t psti_priorities[] = {
+        {"030", STREAM_PRIORITY_HIGH},
+        {"032", STREAM_PRIORITY_MEDIUM},
+        {"033", STREAM_PRIORITY_LOW},
+};
+
+static void epoch_timeout_handler(struct k_work* work);
+
+// The app event manager runs listeners from the system work queue, so this never runs alongside them.
+static K_WORK_DELAYABLE_DEFINE(epoch_timeout, epoch_timeout_handler);
+
+static void flush_epoch(void) {
+    if (epoch.buf == NULL) {
+        return;
+    }
+
+    struct epoch_event* event = new_epoch_event();
+    event->buf = epoch.buf;
+    event->size = epoch.size;
+    event->messages = epoch.messages;
+    event->timestamp = epoch.timestamp;
+    event->pps = epoch.pps;
+    APP_EVENT_SUBMIT(event);
+
+    epoch.buf = NULL;
+    epoch.size = 0;
+    epoch.messages = 0;
+    k_work_cancel_delayable(&epoch_timeout);
+}
+
+static void epoch_timeout_handler(struct k_work* work) {
+    ARG_UNUSED(work);
+
+    flush_epoch();
+}
+
+static void add_to_epoch(const struct gnss_event* event) {
+    if (epoch.buf != NULL && epoch.size + event->size > batch_max_size) {
+        flush_epoch();
+    }
+
+    if (epoch.buf == NULL) {
+        epoch.timestamp = event->timestamp;
+        epoch.pps = event->pps;
+    }
+
+    if (gnss_buf_append(&epoch.buf, event->buf) != 0) {
+        // A partial epoch is worse than none, it's what we're here to stop.
+        if (epoch.buf != NULL) {
+            gnss_buf_unref(epoch.buf);
+        }
+
+        epoch.buf = NULL;
+        epoch.size = 0;
+        epoch.messages = 0;
+        dropped_epochs++;
+        LOG_WRN("Dropped an epoch, out of buffers (%u so far)", dropped_epochs);
+        return;
+    }
+
+    epoch.size += event->size;
+    epoch.messages++;
+    k_work_reschedule(&epoch_timeout, K_MSEC(EPOCH_TIMEOUT_MS));
+}
+
+// The sentences that carry the time of the epoch in their first field.
+static bool has_time_tag(const char* sentence) {
+    static const char* const timed[] = {"GGA", "RMC", "GST", "ZDA", "GNS", "GBS", "GRS"};
+
+    for (size_t i = 0; i < ARRAY_SIZE(timed); ++i) {
+        if (memcmp(sentence, timed[i], 3) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static enum stream_priority_t lookup_nmea_priority(const struct nmea_priority_t* table, size_t count, const char* id) {
+    for (size_t i = 0; i < count; ++i) {
+        if (memcmp(id, table[i].id, 3) == 0) {
+            return table[i].priority;
+        }
+    }
+
+    return STREAM_PRIORITY_MEDIUM;
+}
+
+static enum stream_priority_t rtcm3_priority(uint16_t msg_type) {
+    switch (msg_type) {
+        // Station position, without which a rover can't use anything else.
+        case 1005:
+        case 1006:
+            return STREAM_PRIORITY_CRITICAL;
+        // Antenna and receiver descriptors and GLONASS biases, which a rover mostly needs once.
+        case 1033:
+        case 1230:
+            return STREAM_PRIORITY_HIGH;
+        // Ephemerides, which the rover can get from the sky.
+        case 1019:
+        case 1020:
+        case 1042:
+        case 1044:
+        case 1045:
+        case 1046:
+            return STREAM_PRIORITY_LOW;
+        default:
+            break;
+    }
+
+    // MSM observations for every constellation are the corrections themselves.
+    if (msg_type >= 1071 && msg_type <= 1137) {
+        return STREAM_PRIORITY_CRITICAL;
+    }
+
+    return STREAM_PRIORITY_MEDIUM;
+}
+
+static enum stream_priority_t skytraq_priority(uint8_t msg_id) {
+    switch (msg_id) {
+        case PX1122R_MSG_ID_MEAS_TIME:
+        case PX1122R_MSG_ID_RAW_MEAS:
+            return STREAM_PRIORITY_HIGH;
+        case PX1122R_MSG_ID_SV_CH_STATUS:
+            return STREAM_PRIORITY_LOW;
+        default:
+            return STREAM_PRIORITY_MEDIUM;
+    }
+}
+
+static enum stream_priority_t gnss_event_priority(const struct gnss_event* event) {
+    const struct net_buf* buf = event->buf;
+
+    switch (event->type) {
+        case PX1122R_MSG_FIX:
+            return STREAM_PRIORITY_CRITICAL;
+        case PX1122R_MSG_RTCM3:
+            return rtcm3_priority(event->rtcm3_msg_type);
+        case PX1122R_MSG_SKYTRAQ:
+            return buf->len > 0 ? skytraq_priority(buf->data[0]) : STREAM_PRIORITY_MEDIUM;
+        default:
+            break;
+    }
+
+    // "$ttsss," or "$PSTI,nnn,".
+    const char* p = (const char*)buf->data;
+
+    if (buf->len >= 10 && memcmp(p, "$PSTI,", 6) == 0) {
+        return lookup_nmea_priority(psti_priorities, ARRAY_SIZE(psti_priorities), &p[6]);
+    }
+
+    if (buf->len >= 7 && p[1] != 'P') {
+        return lookup_nmea_priority(nmea_priorities, ARRAY_SIZE(nmea_priorities), &p[3]);
+    }
+
+    return STREAM_PRIORITY_MEDIUM;
+}
+
+// A shed sentence still counts towards finding the edges of the epoch, so the rest of it isn't held up.
+static void handle_nmea(const struct gnss_event* event, bool keep) {
+    // The start of a sentence is always in the first buffer. "$ttsss," at least.
+    const struct net_buf* buf = event->buf;
+    const char* p = (const char*)buf->data;
+
+    if (buf->len < 7 || p[1] == 'P') {
+        if (keep) {
+            add_to_epoch(event);
+        }
+
+        return;
+    }
+
+    const char* sentence = &p[3];
+
+    if (has_time_tag(sentence)) {
+        const char* tag = &p[7];
+        const char* end = memchr(tag, ',', buf->len - 7);
+        uint8_t tag_len = end != NULL ? MIN(end - tag, TIME_TAG_MAX_LEN) : 0;
+
+        if (tag_len > 0 &&
+            (tag_len != epoch.time_tag_len || memcmp(tag, epoch.time_tag, tag_len) != 0)) {
+            flush_epoch();
+            memcpy(epoch.time_tag, tag, tag_len);
+            epoch.time_tag_len = tag_len;
+        }
+    }
+
+    if (keep) {
+        add_to_epoch(event);
+    }
+
+    if (EPOCH_LAST_SENTENCE != NULL && memcmp(sentence, EPOCH_LAST_SENTENCE, 3) == 0) {
+        flush_epoch();
+    }
+}
+
+static bool handle_gnss_event(const struct gnss_event* event) {
+    if (event->buf == NULL) {
+        return false;
+    }
+
+    bool keep = gnss_event_priority(event) >= shed_below;
+
+    if (!keep) {
+        shed_messages++;
+    }
+
+    if (event->type == PX1122R_MSG_NMEA) {
+        handle_nmea(event, keep);
+    } else if (keep) {
+        // Keep everything in the order it arrived.
+        flush_epoch();
+        add_to_epoch(event);
+        flush_epoch();
+    }
+
+    return false;
+}
+
+static bool handle_link_event(const struct link_event* event) {
+    if (event->shed_below != shed_below) {
+        LOG_INF("Shedding below priority %d, was %d (%u shed so far)", event->shed_below, shed_below,
+                shed_messages);
+        shed_below = event->shed_below;
+    }
+
+    uint16_t size = event->notification_size > 0 && event->notification_size <= EPOCH_MAX_SIZE ?
+            EPOCH_MAX_SIZE / event->notification_size * event->notification_size : EPOCH_MAX_SIZE;
+
+    if (size != batch_max_size) {
+        LOG_INF("Batching epochs up to %u bytes, %u byte notifications", size, event->notification_size);
+        batch_max_size = size;
+    }
+
+    return false;
+}
+
+static bool app_event_handler(const struct app_event_header* aeh) {
+    if (is_module_state_event(aeh)) {
+        struct module_state_event* event = cast_module_state_event(aeh);
+
+        if (check_state(event, MODULE_ID(main), MODULE_STATE_READY)) {
+            module_set_state(MODULE_STATE_READY);
+        }
+
+        return false;
+    }
+
+    if (is_gnss_event(aeh)) {
+        return handle_gnss_event(cast_gnss_event(aeh));
+    }
+
+    if (is_link_event(aeh)) {
+        return handle_link_event(cast_link_event(aeh));
+    }
+
+    return false;
+}
+
+APP_EVENT_LISTENER(MODULE, app_event_handler);
+APP_EVENT_SUBSCRIBE(MODULE, module_state_event);
+APP_EVENT_SUBSCRIBE(MODULE, gnss_event);
+APP_EVENT_SUBSCRIBE(MODULE, link_event);
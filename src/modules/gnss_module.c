@@ -1,6 +1,9 @@
 #include "px1122r.h"
 #include "events/data_event.h"
 #include "events/gnss_event.h"
+#include "events/fix_event.h"
+#include "events/link_event.h"
+#include "events/correction_event.h"
 
 #define MODULE gnss
 #include <caf/events/module_state_event.h>
@@ -10,98 +13,520 @@
 LOG_MODULE_REGISTER(MODULE, LOG_LEVEL_DBG);
 static const struct device* dev = DEVICE_DT_GET(DT_INST(0, skytraq_px1122r));
 static bool is_streaming = false;
-
-#define BUF_SIZE 512
-#define NUM_BUFS 2
-
-static uint8_t bufs[NUM_BUFS][BUF_SIZE];
-static uint8_t cur_buf = 0;
+// Set when the button stops the stream, so a config change doesn't start it again behind the user's back.
+static bool stopped_by_hand = false;
+// Fixes only go out as gnss_events in binary mode, where they stand in for the NMEA.
+static enum output_mode_t output_mode = OUTPUT_MODE_NMEA;
 
 #define WORKER_STACK_SIZE 512
 #define WORKER_PRIORITY 6
+// Fastest the nRF UARTE and the PX1122R both support.
+#define MAX_BAUDRATE 921600
 
 K_THREAD_STACK_DEFINE(gnss_worker_stack_area, WORKER_STACK_SIZE);
 
+// Enough for everything at once after boot.
+#define MAX_CONFIG_COMMANDS 9
+// How long to wait before sending everything again after a batch fails.
+#define CONFIG_RETRY_MS 5000
+
+// Changing NMEA intervals resets the receiver, so the rate controller holds each change for a while before making
+// another. It backs off when the link drops or sheds anything or is busy more than THROTTLE_BUSY_PERCENT of the
+// time, and speeds back up after THROTTLE_CALM_REPORTS link report windows in a row under THROTTLE_IDLE_PERCENT, a
+// minute at the usual 5 s window. Speeding up too soon doubles the wait for next time.
+#define THROTTLE_HOLD_MS 30000
+#define THROTTLE_BUSY_PERCENT 80
+#define THROTTLE_IDLE_PERCENT 40
+#define THROTTLE_CALM_REPORTS 12
+#define THROTTLE_MAX_CALM_REPORTS 96
+#define THROTTLE_STEPS 4
+
+// GPS time has been 18 s ahead of UTC since the start of 2017, and NMEA only has UTC.
+#define GPS_UTC_LEAP_MS 18000
+// BeiDou time is 14 s behind GPS time, and GLONASS runs on Moscow time, 3 hours ahead of UTC.
+#define BDT_GPS_MS 14000
+#define GLONASS_UTC_MS (3 * 3600000)
+#define DAY_MS 86400000
+#define CORRECTION_REPORT_INTERVAL_MS 60000
+
+// How many times to halve each sentence's rate at each throttle step. GGA and RMC always go at the configured rate.
+static const struct throttle_step_t {
+    uint8_t gsa;
+    uint8_t gsv;
+    uint8_t vtg;
+    uint8_t zda;
+    uint8_t gst;
+} throttle_steps[THROTTLE_STEPS] = {
+        {0, 0, 0, 0, 0},
+        {0, 1, 0, 0, 0},
+        {1, 2, 1, 1, 0},
+        {2, 3, 2, 2, 1},
+};
+
+static struct throttle_t {
+    uint8_t step;
+    uint8_t calm_reports;
+    uint8_t calm_needed;
+    int64_t last_change;
+    bool last_was_up;
+} throttle = {.calm_needed = THROTTLE_CALM_REPORTS};
+
+// Read by the work handler.
+static atomic_t throttle_step;
+static bool have_config;
+
 static struct k_work_q gnss_work_queue;
 static struct work_item_t {
     struct k_work work;
     struct config_t config;
-    enum data_event_type event_type;
 } gnss_work_item;
 
-static void stream_cb(const uint8_t* buf, uint16_t len) {
-    // TODO: Something clever with incoming data being bigger than our buffer.
-    if (len > BUF_SIZE) {
-        LOG_WRN("Trying to put %d bytes into a %d byte buffer", len, BUF_SIZE);
-        len = BUF_SIZE;
+// What the receiver has been told so far, assuming every batch lands. Only touched from the work queue; a failed batch
+// sets resync and the work handler forgets all of it before the next one.
+static struct receiver_state_t {
+    // The PSTI intervals and talker ID, which never change.
+    bool setup_done;
+    // UINT8_MAX, 0 or false where it isn't known.
+    uint8_t output_mode;
+    uint8_t update_rate;
+    struct px1122r_config_extended_msg_interval_t nmea_intervals;
+    uint8_t meas_rate;
+    bool rtk_known;
+    bool is_base;
+    double latitude;
+    double longitude;
+    float altitude;
+} applied;
+
+static atomic_t resync = ATOMIC_INIT(1);
+
+// Resubmits the config work after a failure, so the receiver doesn't stay half configured until the next change.
+static void config_retry_handler(struct k_work* work);
+static K_WORK_DELAYABLE_DEFINE(config_retry_work, config_retry_handler);
+
+static struct k_work baudrate_work;
+
+// Rover only. GPS time at the last 1PPS edge, so a correction's age can be worked out from its MSM epoch time when
+// it arrives, and what's been seen since the last report.
+static struct correction_stats_t {
+    bool has_time;
+    uint32_t second_ms;
+    uint32_t pps_cycles;
+    uint32_t frames;
+    uint32_t rejected;
+    uint32_t aged;
+    uint64_t age_total_ms;
+    uint32_t age_max_ms;
+    // What the receiver says in GGA, in hundredths of a second.
+    uint16_t receiver_age;
+    int16_t rssi;
+    int8_t snr;
+    int64_t last_report;
+} corrections;
+
+// The commands that never change are framed at compile time and sent straight from flash.
+static const uint8_t psti_interval30[] = PX1122R_FRAME_PSTI_MSG_INTERVAL(30, 0);
+static const uint8_t psti_interval32[] = PX1122R_FRAME_PSTI_MSG_INTERVAL(32, 0);
+static const uint8_t psti_interval33[] = PX1122R_FRAME_PSTI_MSG_INTERVAL(33, 0);
+static const uint8_t talker_id[] = PX1122R_FRAME_NMEA_TALKER_ID(TALKER_ID_GN_MODE);
+static const uint8_t message_type_nmea[] = PX1122R_FRAME_MESSAGE_TYPE(MESSAGE_TYPE_NMEA);
+static const uint8_t message_type_binary[] = PX1122R_FRAME_MESSAGE_TYPE(MESSAGE_TYPE_BINARY);
+
+static void publish_fix(const struct px1122r_msg_t* msg) {
+    struct fix_event* event = new_fix_event();
+
+    memcpy(&event->fix, msg->buf, sizeof(event->fix));
+    event->timestamp = msg->timestamp;
+    event->pps = msg->pps;
+    APP_EVENT_SUBMIT(event);
+}
+
+static void stream_cb(const struct px1122r_msg_t* msg) {
+    if (msg->type == PX1122R_MSG_FIX) {
+        publish_fix(msg);
+
+        if (output_mode != OUTPUT_MODE_BINARY) {
+            return;
+        }
     }
 
-    memcpy(bufs[cur_buf], buf, len);
+    struct net_buf* buf = gnss_buf_alloc(msg->buf, msg->len);
+
+    if (buf == NULL) {
+        LOG_WRN("Dropping %d byte message, the buffer pool is exhausted", msg->len);
+        return;
+    }
 
     struct gnss_event* event = new_gnss_event();
-    event->bytes = bufs[cur_buf];
-    event->size = len;
+    event->buf = buf;
+    event->size = msg->len;
+    event->type = msg->type;
+    event->rtcm3_msg_type = msg->type == PX1122R_MSG_RTCM3 ? msg->rtcm3.msg_type : 0;
+    event->timestamp = msg->timestamp;
+    event->pps = msg->pps;
     APP_EVENT_SUBMIT(event);
-    cur_buf = (cur_buf + 1) % NUM_BUFS;
 }
 
+static void start_stream(void) {
+    if (!device_is_ready(dev)) {
+        return;
+    }
+
+    px1122r_start_stream(dev, stream_cb);
+    is_streaming = true;
+}
+
+// The button stops and starts the stream by hand, whatever the config wants.
 static bool handle_button_event(const struct button_event* event) {
     if (event->pressed) {
         if (!is_streaming) {
-            px1122r_start_stream(dev, stream_cb);
+            start_stream();
+            stopped_by_hand = false;
         } else {
             px1122r_stop_stream(dev);
+            is_streaming = false;
+            stopped_by_hand = true;
         }
+    }
+
+    return false;
+}
+
+// The fix's epoch is in the second that starts at its PPS edge, which pins GPS time to the cycle counter.
+static bool handle_fix_event(const struct fix_event* event) {
+    const struct px1122r_fix_t* fix = &event->fix;
+    uint32_t ms_of_day;
+
+    if (event->pps.sequence == 0 || fix->fix_mode == 0) {
+        return false;
+    }
+
+    if (fix->sources & PX1122R_FIX_FROM_NAV_DATA) {
+        ms_of_day = fix->tow_ms % DAY_MS;
+    } else if (fix->sources & (PX1122R_FIX_FROM_GGA | PX1122R_FIX_FROM_RMC)) {
+        ms_of_day = (fix->utc_time_ms + GPS_UTC_LEAP_MS) % DAY_MS;
+    } else {
+        return false;
+    }
+
+    corrections.second_ms = ms_of_day - ms_of_day % 1000;
+    corrections.pps_cycles = event->pps.cycles;
+    corrections.has_time = true;
+    corrections.receiver_age = fix->correction_age;
+
+    return false;
+}
+
+// MSM messages carry the epoch they were measured at, after the message number and station ID. Only the time of day
+// is kept, in GPS time, as that's all the age needs.
+static bool msm_epoch_ms(struct net_buf* buf, uint16_t msg_type, uint32_t* ms_of_day) {
+    uint8_t head[3 + 7];
 
-        is_streaming = !is_streaming;
+    if (msg_type % 10 == 0 || msg_type % 10 > 7 ||
+        net_buf_linearize(head, sizeof(head), buf, 0, sizeof(head)) != sizeof(head)) {
+        return false;
+    }
+
+    uint32_t epoch = sys_get_be32(&head[3 + 3]) >> 2;
+
+    switch (msg_type / 10) {
+        // GPS, Galileo, SBAS and QZSS have the time of week in GPS time.
+        case 107:
+        case 109:
+        case 110:
+        case 111:
+            *ms_of_day = epoch % DAY_MS;
+            return true;
+        case 112:
+            *ms_of_day = (epoch + BDT_GPS_MS) % DAY_MS;
+            return true;
+        // GLONASS has the day of the week in the top 3 bits, then the time of day.
+        case 108:
+            *ms_of_day = ((epoch & BIT_MASK(27)) + DAY_MS - GLONASS_UTC_MS + GPS_UTC_LEAP_MS) % DAY_MS;
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void report_corrections(int64_t now) {
+    LOG_INF("Corrections %u frames, %u rejected, RSSI %d dBm, SNR %d dB", corrections.frames, corrections.rejected,
+            corrections.rssi, corrections.snr);
+
+    if (corrections.aged > 0) {
+        LOG_INF("Correction age avg %u ms, max %u ms, receiver says %u.%02u s",
+                (uint32_t)(corrections.age_total_ms / corrections.aged), corrections.age_max_ms,
+                corrections.receiver_age / 100, corrections.receiver_age % 100);
+    }
+
+    corrections.frames = 0;
+    corrections.rejected = 0;
+    corrections.aged = 0;
+    corrections.age_total_ms = 0;
+    corrections.age_max_ms = 0;
+    corrections.last_report = now;
+}
+
+// Hands the frame's buffers straight to the driver, which sends them to the receiver from where they are.
+static bool handle_correction_event(const struct correction_event* event) {
+    uint32_t epoch_ms;
+
+    if (corrections.has_time && msm_epoch_ms(event->buf, event->msg_type, &epoch_ms)) {
+        uint32_t now_ms = (corrections.second_ms + k_cyc_to_ms_floor32(k_cycle_get_32() - corrections.pps_cycles)) %
+                DAY_MS;
+        uint32_t age = (now_ms + DAY_MS - epoch_ms) % DAY_MS;
+
+        corrections.aged++;
+        corrections.age_total_ms += age;
+        corrections.age_max_ms = MAX(corrections.age_max_ms, age);
+    }
+
+    corrections.rssi = event->rssi;
+    corrections.snr = event->snr;
+
+    struct net_buf* buf = gnss_buf_ref(event->buf);
+
+    if (px1122r_send_corrections(dev, buf, gnss_buf_unref) != 0) {
+        gnss_buf_unref(buf);
+        corrections.rejected++;
+    } else {
+        corrections.frames++;
+    }
+
+    int64_t now = k_uptime_get();
+
+    if (now - corrections.last_report >= CORRECTION_REPORT_INTERVAL_MS) {
+        report_corrections(now);
     }
 
     return false;
 }
 
 static bool handle_data_event(const struct data_event* event) {
+    // Everything runs off the stream: the survey's fixes, a base's RTCM for LoRa and BLE, epochs, and a rover's
+    // correction ages. A unit with nobody to press the button still has to do its job, so it starts with the config
+    // at boot.
+    if (!is_streaming && !stopped_by_hand) {
+        start_stream();
+    }
+
     gnss_work_item.config = event->config;
-    gnss_work_item.event_type = event->event_type;
+    have_config = true;
     k_work_submit_to_queue(&gnss_work_queue, &gnss_work_item.work);
 
     return false;
 }
 
+static void set_throttle(uint8_t step, int64_t now) {
+    LOG_INF("Throttling NMEA output to step %d of %d", step, THROTTLE_STEPS - 1);
+
+    throttle.step = step;
+    throttle.last_change = now;
+    throttle.calm_reports = 0;
+    atomic_set(&throttle_step, step);
+    k_work_submit_to_queue(&gnss_work_queue, &gnss_work_item.work);
+}
+
+// Closes the loop between what the link is managing to carry and how much the receiver is asked to send.
+static bool handle_link_event(const struct link_event* event) {
+    if (!have_config || output_mode != OUTPUT_MODE_NMEA) {
+        return false;
+    }
+
+    int64_t now = k_uptime_get();
+    bool congested = event->shed_below > STREAM_PRIORITY_LOW || event->dropped > 0 ||
+                     event->utilisation >= THROTTLE_BUSY_PERCENT;
+
+    // Reports sent early for a shed level change repeat the last window's figures, so only the window's own report
+    // counts towards calm. Any report can show congestion.
+    if (congested) {
+        throttle.calm_reports = 0;
+    } else if (event->window_end) {
+        throttle.calm_reports = event->utilisation < THROTTLE_IDLE_PERCENT ?
+                MIN(throttle.calm_reports + 1, UINT8_MAX) : 0;
+    }
+
+    if (now - throttle.last_change < THROTTLE_HOLD_MS) {
+        return false;
+    }
+
+    if (congested && throttle.step < THROTTLE_STEPS - 1) {
+        // Straight back up after coming down means the link couldn't take it, so be more patient next time.
+        if (!throttle.last_was_up && now - throttle.last_change < THROTTLE_HOLD_MS * 4) {
+            throttle.calm_needed = MIN(throttle.calm_needed * 2, THROTTLE_MAX_CALM_REPORTS);
+        }
+
+        throttle.last_was_up = true;
+        set_throttle(throttle.step + 1, now);
+    } else if (throttle.step > 0 && throttle.calm_reports >= throttle.calm_needed) {
+        if (now - throttle.last_change >= THROTTLE_HOLD_MS * 4) {
+            throttle.calm_needed = THROTTLE_CALM_REPORTS;
+        }
+
+        throttle.last_was_up = false;
+        set_throttle(throttle.step - 1, now);
+    }
+
+    return false;
+}
+
+static void config_applied_cb(const struct device* px1122r, uint8_t msg_id, int result, void* user_data) {
+    ARG_UNUSED(px1122r);
+    ARG_UNUSED(user_data);
+
+    if (result != 0) {
+        LOG_ERR("Configuring the receiver failed at command 0x%02x (err %d)", msg_id, result);
+        // There's no telling how much of the batch got through, so everything goes again.
+        atomic_set(&resync, 1);
+        k_work_schedule_for_queue(&gnss_work_queue, &config_retry_work, K_MSEC(CONFIG_RETRY_MS));
+    } else {
+        LOG_DBG("Receiver configured");
+    }
+}
+
+// Raw measurements only come at some of the rates positions do.
+static enum px1122r_meas_rate_t meas_rate(uint8_t update_rate) {
+    if (update_rate >= 20) {
+        return MEAS_RATE_20HZ;
+    } else if (update_rate >= 10) {
+        return MEAS_RATE_10HZ;
+    } else if (update_rate >= 5) {
+        return MEAS_RATE_5HZ;
+    } else if (update_rate >= 4) {
+        return MEAS_RATE_4HZ;
+    } else if (update_rate >= 2) {
+        return MEAS_RATE_2HZ;
+    }
+
+    return MEAS_RATE_1HZ;
+}
+
+static uint8_t slower(uint8_t interval, uint8_t halvings) {
+    return MIN((uint32_t)interval << halvings, UINT8_MAX);
+}
+
+static void forget_receiver_state(void) {
+    applied.setup_done = false;
+    applied.output_mode = UINT8_MAX;
+    applied.update_rate = 0;
+    memset(&applied.nmea_intervals, 0, sizeof(applied.nmea_intervals));
+    applied.meas_rate = UINT8_MAX;
+    applied.rtk_known = false;
+}
+
 static void work_handler(struct k_work* work) {
     struct work_item_t* my_work = (struct work_item_t*) work;
+    const struct config_t* config = &my_work->config;
 
-    uint8_t i = my_work->config.sample_interval;
-    LOG_DBG("Setting the interval to %d", i);
+    output_mode = config->output_mode;
 
-    if (my_work->event_type == DATA_EVENT_CONFIG_INITIAL) {
-        struct px1122r_cmd_psti_interval_t psti_interval = PX1122R_CONFIG_PSTI_MSG_INTERVAL(30, 0);
-        px1122r_send_command(dev, &psti_interval, sizeof(psti_interval));
+    if (atomic_cas(&resync, 1, 0)) {
+        forget_receiver_state();
+    }
 
-        struct px1122r_cmd_psti_interval_t psti_interval32 = PX1122R_CONFIG_PSTI_MSG_INTERVAL(32, 0);
-        px1122r_send_command(dev, &psti_interval32, sizeof(psti_interval32));
+    uint8_t rate = config->update_rate;
+    // The receiver counts NMEA intervals in position updates, not seconds. The data module makes sure it fits.
+    uint8_t i = config->sample_interval == 0 ? 1 : config->sample_interval * rate;
 
-        struct px1122r_cmd_psti_interval_t psti_interval33 = PX1122R_CONFIG_PSTI_MSG_INTERVAL(33, 0);
-        px1122r_send_command(dev, &psti_interval33, sizeof(psti_interval33));
+    // Once the mark's position is known, surveyed or otherwise, a base's receiver is a static base at the antenna
+    // above it. Until then it stays a rover so the survey gets ordinary fixes.
+    bool is_base = config->role == ROLE_BASE && config_has_base_position(config);
+    double lat = config->latitude;
+    double lng = config->longitude;
+    float alt = config->elevation + config->antenna_height;
+    float bll = 0.0f;
 
-        struct px1122r_cmd_nmea_talker_id_t talker_id = PX1122R_CONFIG_NMEA_TALKER_ID(TALKER_ID_GN_MODE);
-        px1122r_send_command(dev, &talker_id, sizeof(talker_id));
+    // Everything is queued as one batch and goes out back to back, so these only have to live until it's queued.
+    struct px1122r_cmd_position_rate_t position_rate = PX1122R_CONFIG_POSITION_RATE(rate);
+    struct px1122r_cmd_binary_meas_output_t meas_output =
+            PX1122R_CONFIG_BINARY_MEAS_OUTPUT(meas_rate(rate), 1, 1, 0, 0);
+    const struct throttle_step_t* step = &throttle_steps[atomic_get(&throttle_step)];
+    struct px1122r_config_extended_msg_interval_t nmea_interval =
+            PX1122R_CONFIG_EXTENDED_MSG_INTERVAL(i, slower(i, step->gsa), slower(i, step->gsv), 0, i,
+                                                 slower(i, step->vtg), slower(i, step->zda), 0, 0, 0, 0,
+                                                 slower(i, step->gst));
+    struct px1122r_cmd_rtk_mode_t msg = PX1122R_CMD_RTK_MODE(is_base ? RTK_MODE_BASE : RTK_MODE_ROVER,
+            is_base ? RTK_BASE_STATIC : 0, 60, 3);
+    px1122r_rtk_mode_set_position(&msg, lat, lng, alt, bll);
+
+    // Only what differs from what the receiver already has goes out, so a config write that doesn't touch the NMEA
+    // intervals doesn't reset the receiver and interrupt the stream.
+    struct px1122r_command_t commands[MAX_CONFIG_COMMANDS];
+    size_t count = 0;
+
+    if (!applied.setup_done) {
+        commands[count++] = (struct px1122r_command_t) PX1122R_FRAMED(psti_interval30);
+        commands[count++] = (struct px1122r_command_t) PX1122R_FRAMED(psti_interval32);
+        commands[count++] = (struct px1122r_command_t) PX1122R_FRAMED(psti_interval33);
+        commands[count++] = (struct px1122r_command_t) PX1122R_FRAMED(talker_id);
+        applied.setup_done = true;
     }
 
-    struct px1122r_config_extended_msg_interval_t nmea_interval =
-            PX1122R_CONFIG_EXTENDED_MSG_INTERVAL(i, i, i, 0, i, i, i, 0, 0, 0, 0, i);
-    px1122r_send_command(dev, &nmea_interval, sizeof(nmea_interval));
-    // The command above resets the PX1122R, and it takes it a little while to start receiving commands again.
-    k_msleep(30);
-
-    double lat = 0.0;
-    double lng = 0.0;
-    float alt = 0.0f;
-    float bll = 0.0f;
-    struct px1122r_cmd_rtk_mode_t msg = PX1122R_CMD_RTK_MODE(0, 0, 60, 3,
-            sys_cpu_to_be64(*(uint64_t*)&lat), sys_cpu_to_be64(*(uint64_t*)&lng),
-            sys_cpu_to_be32(*(uint32_t*)&alt),
-            sys_cpu_to_be32(*(uint32_t*)&bll));
-    px1122r_send_command(dev, &msg, sizeof(msg));
+    if (applied.output_mode != config->output_mode) {
+        commands[count++] = config->output_mode == OUTPUT_MODE_BINARY ?
+                (struct px1122r_command_t) PX1122R_FRAMED(message_type_binary) :
+                (struct px1122r_command_t) PX1122R_FRAMED(message_type_nmea);
+        applied.output_mode = config->output_mode;
+    }
+
+    if (applied.update_rate != rate) {
+        commands[count++] = (struct px1122r_command_t) PX1122R_COMMAND(position_rate);
+        applied.update_rate = rate;
+    }
+
+    // The receiver keeps each set of intervals while the other output type is selected, so they're only sent in
+    // their own mode.
+    if (config->output_mode == OUTPUT_MODE_BINARY) {
+        if (applied.meas_rate != meas_output.output_rate) {
+            commands[count++] = (struct px1122r_command_t) PX1122R_COMMAND(meas_output);
+            applied.meas_rate = meas_output.output_rate;
+        }
+    } else if (memcmp(&applied.nmea_intervals, &nmea_interval, sizeof(nmea_interval)) != 0) {
+        // The extended message interval command resets the PX1122R, and it takes it a little while to start
+        // receiving commands again.
+        commands[count++] = (struct px1122r_command_t) PX1122R_COMMAND_SETTLE(nmea_interval, 30);
+        applied.nmea_intervals = nmea_interval;
+    }
+
+    if (!applied.rtk_known || applied.is_base != is_base || applied.latitude != lat || applied.longitude != lng ||
+        applied.altitude != alt) {
+        commands[count++] = (struct px1122r_command_t) PX1122R_COMMAND(msg);
+        applied.rtk_known = true;
+        applied.is_base = is_base;
+        applied.latitude = lat;
+        applied.longitude = lng;
+        applied.altitude = alt;
+    }
+
+    if (count == 0) {
+        LOG_DBG("Receiver already configured");
+        return;
+    }
+
+    LOG_DBG("Sending %zu configuration commands for %d Hz and an interval of %d", count, rate, i);
+
+    int err = px1122r_send_batch(dev, commands, count, config_applied_cb, NULL);
+    if (err != 0) {
+        LOG_ERR("Failed to queue receiver configuration (err %d)", err);
+        forget_receiver_state();
+        k_work_schedule_for_queue(&gnss_work_queue, &config_retry_work, K_MSEC(CONFIG_RETRY_MS));
+    }
+}
+
+static void config_retry_handler(struct k_work* work) {
+    ARG_UNUSED(work);
+
+    LOG_INF("Retrying the receiver configuration");
+    k_work_submit_to_queue(&gnss_work_queue, &gnss_work_item.work);
+}
+
+static void baudrate_work_handler(struct k_work* work) {
+    ARG_UNUSED(work);
+
+    int baudrate = px1122r_negotiate_baudrate(dev, MAX_BAUDRATE);
+    if (baudrate < 0) {
+        LOG_ERR("Baud rate negotiation failed (err %d)", baudrate);
+    }
 }
 
 static void init_fn(void) {
@@ -113,10 +538,14 @@ static void init_fn(void) {
 
     k_work_queue_init(&gnss_work_queue);
     k_work_init(&gnss_work_item.work, work_handler);
+    k_work_init(&baudrate_work, baudrate_work_handler);
     k_work_queue_start(&gnss_work_queue, gnss_worker_stack_area,
                        K_THREAD_STACK_SIZEOF(gnss_worker_stack_area), WORKER_PRIORITY,
                        NULL);
 
+    // Queued ahead of any configuration so everything else runs at the faster rate.
+    k_work_submit_to_queue(&gnss_work_queue, &baudrate_work);
+
     module_set_state(MODULE_STATE_READY);
 }
 
@@ -140,6 +569,18 @@ static bool app_event_handler(const struct app_event_header *aeh) {
         return handle_data_event(cast_data_event(aeh));
     }
 
+    if (is_link_event(aeh)) {
+        return handle_link_event(cast_link_event(aeh));
+    }
+
+    if (is_fix_event(aeh)) {
+        return handle_fix_event(cast_fix_event(aeh));
+    }
+
+    if (is_correction_event(aeh)) {
+        return handle_correction_event(cast_correction_event(aeh));
+    }
+
     return false;
 }
 
@@ -148,3 +589,6 @@ APP_EVENT_LISTENER(MODULE, app_event_handler);
 APP_EVENT_SUBSCRIBE(MODULE, module_state_event);
 APP_EVENT_SUBSCRIBE(MODULE, data_event);
 APP_EVENT_SUBSCRIBE(MODULE, button_event);
+APP_EVENT_SUBSCRIBE(MODULE, link_event);
+APP_EVENT_SUBSCRIBE(MODULE, fix_event);
+APP_EVENT_SUBSCRIBE(MODULE, correction_event);
@@ -1,6 +1,10 @@
 #define MODULE gnss_io
 
 #include "events/gnss_event.h"
+#include "events/epoch_event.h"
+#include "events/link_event.h"
+#include "events/data_event.h"
+#include "events/correction_event.h"
 
 #include <caf/events/module_state_event.h>
 
@@ -17,25 +21,113 @@ static void bt_connected(struct bt_conn*, uint8_t);
 
 static void bt_disconnected(struct bt_conn*, uint8_t);
 
+static void bt_le_param_updated(struct bt_conn*, uint16_t, uint16_t, uint16_t);
+
+static void bt_le_phy_updated(struct bt_conn*, struct bt_conn_le_phy_info*);
+
+static void bt_le_data_len_updated(struct bt_conn*, struct bt_conn_le_data_len_info*);
+
 #define WORKER_STACK_SIZE 512
 #define WORKER_PRIORITY 7
-#define NUM_WORK_ITEMS 2
+// Epochs waiting to go out. The byte limit is what matters, the slots just have to outnumber the epochs that fit.
+#define TX_QUEUE_SLOTS 16
+#define TX_QUEUE_BYTES 4096
+// Notifications handed to the BLE stack and not yet sent. One less than CONFIG_BT_CONN_TX_MAX leaves room for the
+// stack's own traffic.
+#define TX_CREDITS (CONFIG_BT_CONN_TX_MAX - 1)
+// A link that hasn't sent anything for this long isn't coming back soon, the rest of the epoch is dropped.
+#define TX_CREDIT_TIMEOUT_MS 500
+// Queue depths at which epoch_module starts shedding each priority, lowest first. It stops again once the queue is
+// SHED_HYSTERESIS below the watermark, so it doesn't flap from one epoch to the next.
+#define SHED_WATERMARK_LOW (TX_QUEUE_BYTES / 2)
+#define SHED_WATERMARK_MEDIUM (TX_QUEUE_BYTES * 7 / 10)
+#define SHED_WATERMARK_HIGH (TX_QUEUE_BYTES * 85 / 100)
+#define SHED_HYSTERESIS (TX_QUEUE_BYTES / 8)
+// From the first message of an epoch coming off the UART to handing the whole epoch to the BLE stack. Half an epoch
+// at 20 Hz.
+#define LATENCY_TARGET_US 25000
+#define LATENCY_REPORT_INTERVAL_MS 10000
+// How often the link's utilisation and drops are measured and reported to gnss_module.
+#define LINK_REPORT_INTERVAL_MS 5000
+// Largest notification the L2CAP MTU allows, less the ATT header.
+#define NUS_MAX_PAYLOAD (CONFIG_BT_L2CAP_TX_MTU - 3)
+// What a notification adds before it goes to the link layer: the L2CAP header and the ATT opcode and handle.
+#define NOTIFICATION_OVERHEAD 7
+// 7.5 to 15 ms, so a 10 Hz epoch gets several connection events to go out in.
+#define CONN_INTERVAL_MIN 6
+#define CONN_INTERVAL_MAX 12
+#define CONN_LATENCY 0
+#define CONN_TIMEOUT 400
 
 K_THREAD_STACK_DEFINE(io_worker_stack_area, WORKER_STACK_SIZE);
 
 static struct k_work_q io_work_queue;
-struct io_work_item_t {
-    struct k_work work;
-    int8_t* bytes;
-    uint16_t size;
-};
+static struct k_work tx_work;
+
+// Epochs on their way to BLE, oldest first. When a new one doesn't fit, the oldest waiting epochs are dropped whole
+// until it does: a late epoch is worth less than the one that just arrived, and half an epoch is worth nothing. An
+// epoch bigger than the whole queue is dropped itself. The one being sent has already left the queue and is never
+// dropped here.
+static struct tx_queue_t {
+    struct k_spinlock lock;
+    struct tx_entry_t {
+        // Our own reference, dropped once it's been sent.
+        struct net_buf* buf;
+        uint16_t size;
+        uint32_t timestamp;
+    } entries[TX_QUEUE_SLOTS];
+    uint8_t head;
+    uint8_t count;
+    size_t bytes;
+    size_t high_water;
+    uint32_t dropped_epochs;
+    uint32_t dropped_bytes;
+    enum stream_priority_t shed_below;
+} tx_queue;
+
+static const size_t shed_watermarks[] = {SHED_WATERMARK_LOW, SHED_WATERMARK_MEDIUM, SHED_WATERMARK_HIGH};
+
+// Link events go out from the system work queue so they're sent in order whichever thread moved the queue. It runs
+// every LINK_REPORT_INTERVAL_MS, and straight away when the shed level changes.
+static void link_work_handler(struct k_work* work);
+static K_WORK_DELAYABLE_DEFINE(link_work, link_work_handler);
+
+static size_t current_notification_size(void);
+
+// Counted by the io work queue and collected by link_work_handler at the end of each window.
+static atomic_t link_busy_us;
+static atomic_t link_dropped_bytes;
+
+static struct link_window_t {
+    int64_t start;
+    uint8_t utilisation;
+    uint32_t dropped;
+} link_window;
+
+// One per notification in flight, given back by the NUS sent callback.
+static K_SEM_DEFINE(tx_credits, TX_CREDITS, TX_CREDITS);
+
+static struct latency_stats_t {
+    uint32_t count;
+    uint64_t total_us;
+    uint32_t max_us;
+    uint32_t over_target;
+    uint32_t bytes;
+    uint32_t notifications;
+    int64_t last_report;
+} latency;
 
-static struct io_work_item_t io_work_items[NUM_WORK_ITEMS];
-static uint8_t cur_work_item = 0;
+// Link layer payload the controller agreed to, which starts at the 27 bytes every link supports until data length
+// extension says otherwise.
+static atomic_t ll_tx_max_len = ATOMIC_INIT(27);
 
 APP_EVENT_LISTENER(MODULE, io_app_event_handler);
 APP_EVENT_SUBSCRIBE(MODULE, module_state_event);
+APP_EVENT_SUBSCRIBE(MODULE, epoch_event);
+#ifdef CONFIG_RFM9x
 APP_EVENT_SUBSCRIBE(MODULE, gnss_event);
+APP_EVENT_SUBSCRIBE(MODULE, data_event);
+#endif
 
 LOG_MODULE_REGISTER(MODULE, LOG_LEVEL_DBG);
 
@@ -45,6 +137,9 @@ static struct bt_conn* cur_conn = NULL;
 BT_CONN_CB_DEFINE(MODULE) = {
         .connected = bt_connected,
         .disconnected = bt_disconnected,
+        .le_param_updated = bt_le_param_updated,
+        .le_phy_updated = bt_le_phy_updated,
+        .le_data_len_updated = bt_le_data_len_updated,
 };
 
 static void exchange_func(struct bt_conn* conn, uint8_t err, struct bt_gatt_exchange_params* params) {
@@ -53,11 +148,33 @@ static void exchange_func(struct bt_conn* conn, uint8_t err, struct bt_gatt_exch
 
     if (!err) {
         LOG_INF("MTU exchange done");
+        // epoch_module sizes its batches to the notifications.
+        k_work_reschedule(&link_work, K_NO_WAIT);
     } else {
         LOG_WRN("MTU exchange failed (err %" PRIu8 ")", err);
     }
 }
 
+// The phone picks what it actually allows, but it won't offer any of this unless it's asked. Long packets on 2M PHY
+// and a short interval get the most through.
+static void tune_connection(struct bt_conn* conn) {
+    int err = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+    if (err) {
+        LOG_WRN("Data length update failed (err %d)", err);
+    }
+
+    err = bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M);
+    if (err) {
+        LOG_WRN("PHY update failed (err %d)", err);
+    }
+
+    err = bt_conn_le_param_update(conn,
+            BT_LE_CONN_PARAM(CONN_INTERVAL_MIN, CONN_INTERVAL_MAX, CONN_LATENCY, CONN_TIMEOUT));
+    if (err) {
+        LOG_WRN("Connection parameter update failed (err %d)", err);
+    }
+}
+
 static void bt_connected(struct bt_conn* conn, uint8_t con_err) {
     ARG_UNUSED(con_err);
     static struct bt_gatt_exchange_params exchange_params;
@@ -68,6 +185,9 @@ static void bt_connected(struct bt_conn* conn, uint8_t con_err) {
         LOG_WRN("MTU exchange failed (err %d)", err);
     }
 
+    atomic_set(&ll_tx_max_len, 27);
+    tune_connection(conn);
+
     cur_conn = bt_conn_ref(conn);
 }
 
@@ -78,42 +198,699 @@ static void bt_disconnected(struct bt_conn* conn, uint8_t reason) {
         bt_conn_unref(cur_conn);
         cur_conn = NULL;
     }
+
+    // Whatever was in flight went with the connection, and its sent callbacks with it.
+    k_sem_reset(&tx_credits);
+    for (int i = 0; i < TX_CREDITS; ++i) {
+        k_sem_give(&tx_credits);
+    }
+}
+
+static void bt_le_param_updated(struct bt_conn* conn, uint16_t interval, uint16_t latency, uint16_t timeout) {
+    ARG_UNUSED(conn);
+
+    LOG_INF("Connection interval %u us, latency %u, timeout %u ms", interval * 1250U, latency, timeout * 10U);
+}
+
+static void bt_le_phy_updated(struct bt_conn* conn, struct bt_conn_le_phy_info* param) {
+    ARG_UNUSED(conn);
+
+    LOG_INF("PHY TX %u RX %u", param->tx_phy, param->rx_phy);
+}
+
+static void bt_le_data_len_updated(struct bt_conn* conn, struct bt_conn_le_data_len_info* info) {
+    ARG_UNUSED(conn);
+
+    LOG_INF("Data length TX %u bytes/%u us, RX %u bytes/%u us", info->tx_max_len, info->tx_max_time,
+            info->rx_max_len, info->rx_max_time);
+    atomic_set(&ll_tx_max_len, info->tx_max_len);
+    k_work_reschedule(&link_work, K_NO_WAIT);
 }
 
 #ifdef CONFIG_RFM9x
+// The top of the 868.0-868.6 MHz sub-band's 1% duty cycle and 14 dBm, centred so 500 kHz still fits inside it.
+#define LORA_FREQUENCY 868300000
+#define LORA_TX_POWER_DBM 14
+// Path loss the link has to survive. The fastest modem settings that still leave this much are used.
+#define LORA_LINK_BUDGET_DB 134
+#define LORA_QUEUE_LEN 16
+// RTCM messages for an epoch come out back to back. Anything within this of the last one shares its packets.
+#define LORA_BATCH_MS 20
+#define LORA_MAX_PACKET 255
+// A sequence number, then the offset into the payload where the first RTCM frame starts, so a rover that missed the
+// last packet knows where to pick up again.
+#define LORA_HEADER_LEN 2
+#define LORA_NO_FRAME_START 0xff
+#define LORA_STACK_SIZE 1024
+#define LORA_PRIORITY 8
+// ETSI EN 300 220 allows the sub-band 1% of any hour on air. The hour is kept in slots, one more than it needs so
+// their sum always covers at least the whole of the last hour.
+#define LORA_DUTY_CYCLE_PERCENT 1
+#define LORA_DUTY_WINDOW_S 3600
+#define LORA_DUTY_SLOT_S 60
+#define LORA_DUTY_SLOTS (LORA_DUTY_WINDOW_S / LORA_DUTY_SLOT_S + 1)
+#define LORA_DUTY_BUDGET_US (LORA_DUTY_WINDOW_S * 10000U * LORA_DUTY_CYCLE_PERCENT)
+// The hourly budget alone would let it all go in the first minute. Airtime is also earned at the duty cycle, and
+// this much can be saved up while there's nothing to send.
+#define LORA_CREDIT_MAX_US (LORA_DUTY_BUDGET_US / 4)
+#define LORA_ARP_INTERVAL_MS 10000
+// Anything that isn't observations or the station position waits here for spare airtime, newest of each type only.
+#define LORA_DEFERRED_LEN 4
+// After which it goes ahead of the observations.
+#define LORA_DEFERRED_MAX_WAIT_MS 60000
+#define RTCM3_PREAMBLE 0xd3
+#define RTCM3_HEADER_LEN 3
+// Header and CRC around the payload.
+#define RTCM3_OVERHEAD 6
+
 static const struct device* dev = DEVICE_DT_GET(DT_INST(0, hoperf_rfm9x));
 
-static bool lora_init() {
-    if (!device_is_ready(dev)) {
-        LOG_ERR("RFM9x not ready.");
-        return false;
+K_THREAD_STACK_DEFINE(lora_worker_stack_area, LORA_STACK_SIZE);
+
+static struct k_work_q lora_work_queue;
+static struct k_work lora_work;
+static struct k_work lora_role_work;
+// What the config says, and what the radio is actually doing. Sending is the default.
+static atomic_t lora_rover;
+static bool lora_receiving;
+
+struct lora_item_t {
+    // Our own reference to one RTCM frame.
+    struct net_buf* buf;
+    uint16_t len;
+    uint16_t msg_type;
+    uint32_t queued_ms;
+};
+
+enum lora_class_t {
+    LORA_CLASS_ARP,
+    LORA_CLASS_MSM,
+    LORA_CLASS_OTHER,
+};
+
+K_MSGQ_DEFINE(lora_queue, sizeof(struct lora_item_t), LORA_QUEUE_LEN, 4);
+
+// Only the LoRa work queue touches these.
+static struct lora_packet_t {
+    uint8_t buf[LORA_MAX_PACKET];
+    size_t len;
+    uint8_t sequence;
+    uint8_t frame_start;
+} lora_packet = {.len = LORA_HEADER_LEN, .frame_start = LORA_NO_FRAME_START};
+
+static atomic_t lora_ready;
+// What lora_choose_modem settled on, for working out time on air.
+static struct lora_modem_config lora_modem;
+
+// Only the LoRa work queue touches these.
+static struct lora_duty_t {
+    uint32_t credit_us;
+    int64_t refilled_ms;
+    uint32_t slots[LORA_DUTY_SLOTS];
+    uint32_t slot;
+    int64_t arp_sent_ms;
+    bool arp_sent;
+    // How long an epoch's observations usually take, kept back from the deferred messages for the next one.
+    uint32_t msm_avg_us;
+    // Oldest first.
+    struct lora_item_t deferred[LORA_DEFERRED_LEN];
+    size_t num_deferred;
+} lora_duty = {.credit_us = LORA_CREDIT_MAX_US};
+
+static struct lora_stats_t {
+    atomic_t packets;
+    atomic_t bytes;
+    atomic_t failed;
+    atomic_t dropped;
+    atomic_t airtime_us;
+    atomic_t hour_us;
+    // Observation epochs that didn't fit the budget, and messages replaced by a newer one of the same type.
+    atomic_t held_back;
+    atomic_t superseded;
+} lora_stats;
+
+// Only the RFM9x driver's work queue touches these, from the receive callback.
+static struct lora_rx_t {
+    // Whether we know where the frames are. Lost after a missing packet until one comes along with a frame start.
+    bool synced;
+    uint8_t expected_sequence;
+    // The frame being put back together, from the gnss_event pool, and its length once the header is in.
+    struct net_buf* frame;
+    uint16_t have;
+    uint16_t frame_len;
+} lora_rx;
+
+static struct lora_rx_stats_t {
+    atomic_t packets;
+    atomic_t bytes;
+    atomic_t lost;
+    atomic_t frames;
+    atomic_t dropped;
+    atomic_t rssi;
+    atomic_t snr;
+} lora_rx_stats;
+
+// RFM95 sensitivity at 125 kHz from SF7 to SF12 in tenths of a dB. Each doubling of the bandwidth costs 3 dB.
+static const int16_t lora_sensitivity[] = {-1230, -1260, -1290, -1320, -1345, -1370};
+
+static void lora_choose_modem(struct lora_modem_config* cfg) {
+    static const uint32_t bandwidths[] = {125000, 250000, 500000};
+    uint32_t best_rate = 0;
+
+    cfg->datarate = SF_12;
+    cfg->bandwidth = BW_125_KHZ;
+
+    for (size_t bw = 0; bw < ARRAY_SIZE(bandwidths); ++bw) {
+        for (int sf = SF_7; sf <= SF_12; ++sf) {
+            int sensitivity = lora_sensitivity[sf - SF_7] + 30 * bw;
+            // Bits per second at 4/5 coding.
+            uint32_t rate = sf * bandwidths[bw] * 4 / (5 * BIT(sf));
+
+            if (LORA_TX_POWER_DBM * 10 - sensitivity >= LORA_LINK_BUDGET_DB * 10 && rate > best_rate) {
+                best_rate = rate;
+                cfg->datarate = sf;
+                cfg->bandwidth = (enum lora_signal_bandwidth) bw;
+            }
+        }
     }
 
+    LOG_INF("LoRa SF%d at %u kHz, %u bit/s", cfg->datarate, bandwidths[cfg->bandwidth] / 1000, best_rate);
+}
+
+// Both ends use the same settings, so a rover hears whatever a base with the same firmware sends.
+static bool lora_configure(bool tx) {
     struct lora_modem_config cfg;
-    cfg.frequency = 868000000;
-    cfg.datarate = SF_7;
-    cfg.bandwidth = BW_500_KHZ;
+    cfg.frequency = LORA_FREQUENCY;
     cfg.coding_rate = CR_4_5;
     cfg.preamble_len = 8;
-    cfg.tx = false;
+    cfg.tx_power = LORA_TX_POWER_DBM;
+    cfg.tx = tx;
+    lora_choose_modem(&cfg);
 
-    lora_config(dev, &cfg);
+    int err = lora_config(dev, &cfg);
+    if (err != 0) {
+        LOG_ERR("LoRa config failed (err %d)", err);
+        return false;
+    }
+
+    lora_modem = cfg;
 
     return true;
 }
+
+static bool lora_init() {
+    if (!device_is_ready(dev)) {
+        LOG_ERR("RFM9x not ready.");
+        return false;
+    }
+
+    return lora_configure(true);
+}
+
+// Semtech's time on air for the SX127x, with an explicit header and the payload CRC the driver always turns on.
+static uint32_t lora_airtime_us(size_t len) {
+    static const uint32_t bandwidths_khz[] = {125, 250, 500};
+    int sf = lora_modem.datarate;
+    uint32_t symbol_us = BIT(sf) * 1000 / bandwidths_khz[lora_modem.bandwidth];
+    // The driver turns on low data rate optimisation at the same point.
+    int de = symbol_us > 16000 ? 1 : 0;
+    int bits = 8 * (int)len - 4 * sf + 28 + 16;
+    uint32_t symbols = 8;
+
+    if (bits > 0) {
+        symbols += DIV_ROUND_UP(bits, 4 * (sf - 2 * de)) * (lora_modem.coding_rate + 4);
+    }
+
+    // The preamble has 4.25 symbols on top of its length.
+    return (lora_modem.preamble_len * 4 + 17) * symbol_us / 4 + symbols * symbol_us;
+}
+
+// For this many bytes of frames packed the way lora_append packs them.
+static uint32_t lora_batch_airtime_us(size_t bytes) {
+    const size_t payload = LORA_MAX_PACKET - LORA_HEADER_LEN;
+    size_t rest = bytes % payload;
+    uint32_t us = (bytes / payload) * lora_airtime_us(LORA_MAX_PACKET);
+
+    if (rest != 0) {
+        us += lora_airtime_us(rest + LORA_HEADER_LEN);
+    }
+
+    return us;
+}
+
+static void lora_duty_advance(int64_t now) {
+    uint32_t slot = (uint32_t)(now / (LORA_DUTY_SLOT_S * 1000));
+
+    if (slot - lora_duty.slot >= LORA_DUTY_SLOTS) {
+        memset(lora_duty.slots, 0, sizeof(lora_duty.slots));
+        lora_duty.slot = slot;
+    }
+
+    while (lora_duty.slot != slot) {
+        lora_duty.slot++;
+        lora_duty.slots[lora_duty.slot % LORA_DUTY_SLOTS] = 0;
+    }
+
+    // Microseconds earned per millisecond is ten times the percentage.
+    uint64_t earned = (uint64_t)(now - lora_duty.refilled_ms) * 10 * LORA_DUTY_CYCLE_PERCENT;
+
+    lora_duty.credit_us = MIN(lora_duty.credit_us + earned, LORA_CREDIT_MAX_US);
+    lora_duty.refilled_ms = now;
+}
+
+static uint32_t lora_duty_used(void) {
+    uint32_t used = 0;
+
+    for (size_t i = 0; i < LORA_DUTY_SLOTS; ++i) {
+        used += lora_duty.slots[i];
+    }
+
+    return used;
+}
+
+static uint32_t lora_duty_available(void) {
+    uint32_t used = lora_duty_used();
+
+    return used >= LORA_DUTY_BUDGET_US ? 0 : MIN(lora_duty.credit_us, LORA_DUTY_BUDGET_US - used);
+}
+
+static void lora_duty_charge(uint32_t us) {
+    lora_duty.credit_us -= MIN(lora_duty.credit_us, us);
+    lora_duty.slots[lora_duty.slot % LORA_DUTY_SLOTS] += us;
+    atomic_add(&lora_stats.airtime_us, us);
+    atomic_set(&lora_stats.hour_us, lora_duty_used());
+}
+
+static enum lora_class_t lora_classify(uint16_t msg_type) {
+    if (msg_type == 1005 || msg_type == 1006) {
+        return LORA_CLASS_ARP;
+    }
+
+    // MSM1 to MSM7 for every constellation.
+    if (msg_type >= 1071 && msg_type <= 1137 && msg_type % 10 >= 1 && msg_type % 10 <= 7) {
+        return LORA_CLASS_MSM;
+    }
+
+    return LORA_CLASS_OTHER;
+}
+
+// Only the newest of each type is worth sending, so one that's already waiting is replaced but keeps its place.
+static void lora_defer(const struct lora_item_t* item) {
+    for (size_t i = 0; i < lora_duty.num_deferred; ++i) {
+        struct lora_item_t* deferred = &lora_duty.deferred[i];
+
+        if (deferred->msg_type == item->msg_type) {
+            gnss_buf_unref(deferred->buf);
+            deferred->buf = item->buf;
+            deferred->len = item->len;
+            atomic_inc(&lora_stats.superseded);
+            return;
+        }
+    }
+
+    if (lora_duty.num_deferred == LORA_DEFERRED_LEN) {
+        gnss_buf_unref(lora_duty.deferred[0].buf);
+        memmove(&lora_duty.deferred[0], &lora_duty.deferred[1],
+                (LORA_DEFERRED_LEN - 1) * sizeof(lora_duty.deferred[0]));
+        lora_duty.num_deferred--;
+        atomic_inc(&lora_stats.superseded);
+    }
+
+    lora_duty.deferred[lora_duty.num_deferred++] = *item;
+}
+
+// Hands over the deferred messages that fit, oldest first, or only those that have waited too long.
+static size_t lora_take_deferred(struct lora_item_t* send, size_t* bytes, uint32_t available, uint32_t reserve_us,
+                                 bool overdue_only) {
+    uint32_t now = k_uptime_get_32();
+    size_t taken = 0;
+    size_t kept = 0;
+
+    for (size_t i = 0; i < lora_duty.num_deferred; ++i) {
+        struct lora_item_t* item = &lora_duty.deferred[i];
+        bool overdue = now - item->queued_ms >= LORA_DEFERRED_MAX_WAIT_MS;
+
+        if ((!overdue_only || overdue) && lora_batch_airtime_us(*bytes + item->len) + reserve_us <= available) {
+            send[taken++] = *item;
+            *bytes += item->len;
+        } else {
+            lora_duty.deferred[kept++] = *item;
+        }
+    }
+
+    lora_duty.num_deferred = kept;
+
+    return taken;
+}
+
+static void lora_release_deferred(void) {
+    for (size_t i = 0; i < lora_duty.num_deferred; ++i) {
+        gnss_buf_unref(lora_duty.deferred[i].buf);
+    }
+
+    lora_duty.num_deferred = 0;
+}
+
+static void lora_flush(void) {
+    if (lora_packet.len <= LORA_HEADER_LEN) {
+        return;
+    }
+
+    lora_packet.buf[0] = lora_packet.sequence++;
+    lora_packet.buf[1] = lora_packet.frame_start;
+
+    int err = lora_send(dev, lora_packet.buf, lora_packet.len);
+    if (err != 0) {
+        LOG_WRN("LoRa send failed (err %d)", err);
+        atomic_inc(&lora_stats.failed);
+    } else {
+        atomic_inc(&lora_stats.packets);
+        atomic_add(&lora_stats.bytes, lora_packet.len);
+        lora_duty_charge(lora_airtime_us(lora_packet.len));
+    }
+
+    lora_packet.len = LORA_HEADER_LEN;
+    lora_packet.frame_start = LORA_NO_FRAME_START;
+}
+
+// Frames are packed end to end and split across packets wherever they fall, so every packet but the last of a batch
+// goes out full.
+static void lora_append(struct net_buf* buf) {
+    size_t total = net_buf_frags_len(buf);
+
+    if (lora_packet.frame_start == LORA_NO_FRAME_START) {
+        lora_packet.frame_start = lora_packet.len - LORA_HEADER_LEN;
+    }
+
+    for (size_t offset = 0; offset < total;) {
+        size_t room = LORA_MAX_PACKET - lora_packet.len;
+        size_t len = net_buf_linearize(&lora_packet.buf[lora_packet.len], room, buf, offset, room);
+
+        if (len == 0) {
+            break;
+        }
+
+        offset += len;
+        lora_packet.len += len;
+
+        if (lora_packet.len == LORA_MAX_PACKET) {
+            lora_flush();
+        }
+    }
+}
+
+// Decides what an epoch's worth of frames gets on air. The station position goes first when it's due and is dropped
+// otherwise, the receiver repeats it. Then anything that has been deferred too long, then the epoch's observations,
+// all or none so a rover doesn't end up with only the first constellation every time. Whatever else fits after
+// keeping back enough for the next epoch's observations goes last.
+static void lora_work_handler(struct k_work* work) {
+    ARG_UNUSED(work);
+
+    // Only this work item uses them, and they'd take a good part of the stack lora_send needs.
+    static struct lora_item_t batch[LORA_QUEUE_LEN];
+    static struct lora_item_t send[LORA_QUEUE_LEN + LORA_DEFERRED_LEN];
+    size_t count = 0;
+    size_t sending = 0;
+    size_t bytes = 0;
+    size_t msm_bytes = 0;
+
+    while (count < ARRAY_SIZE(batch) && k_msgq_get(&lora_queue, &batch[count], K_MSEC(LORA_BATCH_MS)) == 0) {
+        ++count;
+    }
+
+    int64_t now = k_uptime_get();
+    bool arp_due = !lora_duty.arp_sent || now - lora_duty.arp_sent_ms >= LORA_ARP_INTERVAL_MS;
+
+    lora_duty_advance(now);
+
+    uint32_t available = lora_duty_available();
+
+    for (size_t i = 0; i < count; ++i) {
+        struct lora_item_t* item = &batch[i];
+
+        switch (lora_classify(item->msg_type)) {
+            case LORA_CLASS_ARP:
+                if (arp_due && lora_batch_airtime_us(bytes + item->len) <= available) {
+                    send[sending++] = *item;
+                    bytes += item->len;
+                    lora_duty.arp_sent = true;
+                    lora_duty.arp_sent_ms = now;
+                } else {
+                    gnss_buf_unref(item->buf);
+                }
+
+                item->buf = NULL;
+                break;
+            case LORA_CLASS_MSM:
+                msm_bytes += item->len;
+                break;
+            default:
+                lora_defer(item);
+                item->buf = NULL;
+                break;
+        }
+    }
+
+    sending += lora_take_deferred(&send[sending], &bytes, available, 0, true);
+
+    if (msm_bytes != 0) {
+        uint32_t msm_us = lora_batch_airtime_us(msm_bytes);
+        bool fits = lora_batch_airtime_us(bytes + msm_bytes) <= available;
+
+        lora_duty.msm_avg_us = lora_duty.msm_avg_us == 0 ? msm_us : (lora_duty.msm_avg_us * 7 + msm_us) / 8;
+
+        for (size_t i = 0; i < count; ++i) {
+            if (batch[i].buf == NULL) {
+                continue;
+            }
+
+            if (fits) {
+                send[sending++] = batch[i];
+            } else {
+                gnss_buf_unref(batch[i].buf);
+            }
+        }
+
+        if (fits) {
+            bytes += msm_bytes;
+        } else {
+            atomic_inc(&lora_stats.held_back);
+        }
+    }
+
+    sending += lora_take_deferred(&send[sending], &bytes, available, lora_duty.msm_avg_us, false);
+
+    for (size_t i = 0; i < sending; ++i) {
+        lora_append(send[i].buf);
+        gnss_buf_unref(send[i].buf);
+    }
+
+    lora_flush();
+
+    // There's more waiting, the queue filled up before the batch ended.
+    if (count == ARRAY_SIZE(batch)) {
+        k_work_submit_to_queue(&lora_work_queue, &lora_work);
+    }
+}
+
+// Taken straight from the receiver's messages rather than from the epochs, which have already had whatever the BLE
+// link can't keep up with shed. The duty cycle scheduler does its own choosing.
+static bool handle_gnss_event(const struct gnss_event* event) {
+    if (!atomic_get(&lora_ready) || atomic_get(&lora_rover) || event->type != PX1122R_MSG_RTCM3 ||
+        event->buf == NULL) {
+        return false;
+    }
+
+    struct lora_item_t item = {
+        .buf = gnss_buf_ref(event->buf),
+        .len = event->size,
+        .msg_type = event->rtcm3_msg_type,
+        .queued_ms = k_uptime_get_32(),
+    };
+
+    if (k_msgq_put(&lora_queue, &item, K_NO_WAIT) != 0) {
+        gnss_buf_unref(item.buf);
+        atomic_inc(&lora_stats.dropped);
+        return false;
+    }
+
+    k_work_submit_to_queue(&lora_work_queue, &lora_work);
+
+    return false;
+}
+
+static void lora_rx_drop_frame(void) {
+    if (lora_rx.frame != NULL) {
+        gnss_buf_unref(lora_rx.frame);
+        lora_rx.frame = NULL;
+        atomic_inc(&lora_rx_stats.dropped);
+    }
+
+    lora_rx.have = 0;
+    lora_rx.frame_len = 0;
+}
+
+static void lora_rx_deliver(int16_t rssi, int8_t snr) {
+    struct net_buf* frame = lora_rx.frame;
+    // The header is always in the first buffer, the pool's buffers are bigger than that.
+    const uint8_t* p = frame->data;
+
+    struct correction_event* event = new_correction_event();
+    event->buf = frame;
+    event->size = lora_rx.frame_len;
+    event->msg_type = ((uint16_t)p[3] << 4) | (p[4] >> 4);
+    event->received_ms = k_uptime_get_32();
+    event->rssi = rssi;
+    event->snr = snr;
+    APP_EVENT_SUBMIT(event);
+
+    atomic_inc(&lora_rx_stats.frames);
+    lora_rx.frame = NULL;
+    lora_rx.have = 0;
+    lora_rx.frame_len = 0;
+}
+
+// Undoes lora_append. Frames are copied out of the radio's buffer into pool buffers as they arrive, and each one is
+// handed on in those same buffers once it's whole. The LoRa CRC has already vouched for each packet, and the receiver
+// checks each frame's own CRC.
+static void lora_received(const struct device* lora_dev, uint8_t* data, uint16_t size, int16_t rssi, int8_t snr) {
+    ARG_UNUSED(lora_dev);
+
+    if (size <= LORA_HEADER_LEN) {
+        return;
+    }
+
+    uint8_t sequence = data[0];
+    uint8_t frame_start = data[1];
+    const uint8_t* p = data + LORA_HEADER_LEN;
+    size_t len = size - LORA_HEADER_LEN;
+
+    atomic_inc(&lora_rx_stats.packets);
+    atomic_add(&lora_rx_stats.bytes, size);
+    atomic_set(&lora_rx_stats.rssi, rssi);
+    atomic_set(&lora_rx_stats.snr, snr);
+
+    // A missing packet takes the rest of the frame in progress with it.
+    if (lora_rx.synced && sequence != lora_rx.expected_sequence) {
+        atomic_add(&lora_rx_stats.lost, (uint8_t)(sequence - lora_rx.expected_sequence));
+        lora_rx_drop_frame();
+        lora_rx.synced = false;
+    }
+
+    lora_rx.expected_sequence = sequence + 1;
+
+    if (!lora_rx.synced) {
+        if (frame_start == LORA_NO_FRAME_START || frame_start >= len) {
+            return;
+        }
+
+        p += frame_start;
+        len -= frame_start;
+        lora_rx.synced = true;
+    }
+
+    while (len > 0) {
+        // Frames are packed end to end, so anything but a preamble here means we've lost our place.
+        if (lora_rx.have == 0 && p[0] != RTCM3_PREAMBLE) {
+            lora_rx.synced = false;
+            return;
+        }
+
+        // The header first, to find out how long the frame is.
+        size_t n = MIN(len, (lora_rx.frame_len != 0 ? lora_rx.frame_len : RTCM3_HEADER_LEN) - lora_rx.have);
+
+        if (gnss_buf_append_mem(&lora_rx.frame, p, n) != 0) {
+            lora_rx_drop_frame();
+            lora_rx.synced = false;
+            return;
+        }
+
+        lora_rx.have += n;
+        p += n;
+        len -= n;
+
+        if (lora_rx.frame_len == 0 && lora_rx.have == RTCM3_HEADER_LEN) {
+            const uint8_t* header = lora_rx.frame->data;
+
+            lora_rx.frame_len = ((((uint16_t)header[1] & 0x03) << 8) | header[2]) + RTCM3_OVERHEAD;
+        }
+
+        if (lora_rx.have == lora_rx.frame_len) {
+            lora_rx_deliver(rssi, snr);
+        }
+    }
+}
+
+// Switches between sending and receiving when the role changes.
+static void lora_role_work_handler(struct k_work* work) {
+    ARG_UNUSED(work);
+
+    bool rover = atomic_get(&lora_rover);
+
+    if (rover == lora_receiving) {
+        return;
+    }
+
+    if (rover) {
+        // Nothing is going to send them now.
+        lora_release_deferred();
+
+        if (!lora_configure(false)) {
+            return;
+        }
+
+        int err = lora_recv_async(dev, lora_received);
+        if (err != 0) {
+            LOG_ERR("LoRa receive failed to start (err %d)", err);
+            return;
+        }
+
+        LOG_INF("LoRa receiving corrections");
+    } else {
+        lora_recv_async(dev, NULL);
+
+        // Nothing else touches it once receiving has stopped.
+        lora_rx.synced = false;
+        lora_rx_drop_frame();
+
+        if (!lora_configure(true)) {
+            return;
+        }
+
+        LOG_INF("LoRa sending corrections");
+    }
+
+    lora_receiving = rover;
+}
+
+static bool handle_data_event(const struct data_event* event) {
+    atomic_set(&lora_rover, event->config.role == ROLE_ROVER);
+
+    if (atomic_get(&lora_ready)) {
+        k_work_submit_to_queue(&lora_work_queue, &lora_role_work);
+    }
+
+    return false;
+}
 #endif
 
 //static void bt_receive_cb(struct bt_conn* conn, const uint8_t* const data, uint16_t len) {
 //
 //}
-//
-//static struct bt_nus_cb nus_cb = {
+
+static void bt_sent_cb(struct bt_conn* conn) {
+    ARG_UNUSED(conn);
+
+    k_sem_give(&tx_credits);
+}
+
+static struct bt_nus_cb nus_cb = {
 //        .received = bt_receive_cb,
-//};
+        .sent = bt_sent_cb,
+};
 
 static bool init_btuart() {
-    int err = bt_nus_init(NULL);
-//    int err = bt_nus_init(&nus_cb);
+    int err = bt_nus_init(&nus_cb);
 
     if (err != 0) {
         LOG_ERR("Failed to initialize UART service (err: %d)", err);
@@ -123,21 +900,304 @@ static bool init_btuart() {
     return true;
 }
 
-static void work_handler(struct k_work* work) {
-    struct io_work_item_t* my_work = (struct io_work_item_t*) work;
-    bt_nus_send(NULL, my_work->bytes, my_work->size);
+// Called with the queue locked whenever its depth changes. Returns true if the shed level moved.
+static bool update_shed_level(void) {
+    enum stream_priority_t level = tx_queue.shed_below;
+
+    while (level < STREAM_PRIORITY_CRITICAL && tx_queue.bytes >= shed_watermarks[level]) {
+        level++;
+    }
+
+    while (level > STREAM_PRIORITY_LOW && tx_queue.bytes + SHED_HYSTERESIS < shed_watermarks[level - 1]) {
+        level--;
+    }
+
+    if (level == tx_queue.shed_below) {
+        return false;
+    }
+
+    tx_queue.shed_below = level;
+
+    return true;
 }
 
-static bool handle_gnss_event(const struct gnss_event* event) {
-    struct io_work_item_t* work_item = &io_work_items[cur_work_item];
+static void link_work_handler(struct k_work* work) {
+    ARG_UNUSED(work);
+
+    int64_t now = k_uptime_get();
+    int64_t elapsed = now - link_window.start;
+
+    k_spinlock_key_t key = k_spin_lock(&tx_queue.lock);
+    enum stream_priority_t level = tx_queue.shed_below;
+    k_spin_unlock(&tx_queue.lock, key);
+
+    // A shed level change partway through a window goes out with the last full window's figures.
+    bool window_end = elapsed >= LINK_REPORT_INTERVAL_MS;
+
+    if (window_end) {
+        uint32_t busy_us = (uint32_t)atomic_clear(&link_busy_us);
+
+        link_window.utilisation = (uint8_t)MIN((uint64_t)busy_us / 10 / elapsed, 100);
+        link_window.dropped = (uint32_t)atomic_clear(&link_dropped_bytes);
+        link_window.start = now;
+        elapsed = 0;
+    }
+
+    struct link_event* event = new_link_event();
+    event->shed_below = level;
+    event->window_end = window_end;
+    event->utilisation = link_window.utilisation;
+    event->dropped = link_window.dropped;
+    event->notification_size = current_notification_size();
+    APP_EVENT_SUBMIT(event);
 
-    if (!k_work_is_pending(&work_item->work)) {
-        work_item->bytes = event->bytes;
-        work_item->size = event->size;
-        k_work_submit_to_queue(&io_work_queue, &work_item->work);
-        cur_work_item = (cur_work_item + 1) % NUM_WORK_ITEMS;
+    k_work_reschedule(&link_work, K_MSEC(LINK_REPORT_INTERVAL_MS - elapsed));
+}
+
+static bool tx_queue_put(struct net_buf* buf, uint16_t size, uint32_t timestamp) {
+    struct net_buf* dropped[TX_QUEUE_SLOTS];
+    size_t num_dropped = 0;
+    size_t dropped_bytes = 0;
+    bool queued = false;
+
+    k_spinlock_key_t key = k_spin_lock(&tx_queue.lock);
+
+    if (size <= TX_QUEUE_BYTES) {
+        while (tx_queue.count == TX_QUEUE_SLOTS || tx_queue.bytes + size > TX_QUEUE_BYTES) {
+            struct tx_entry_t* oldest = &tx_queue.entries[tx_queue.head];
+
+            dropped[num_dropped++] = oldest->buf;
+            dropped_bytes += oldest->size;
+            tx_queue.bytes -= oldest->size;
+            tx_queue.dropped_epochs++;
+            tx_queue.dropped_bytes += oldest->size;
+            tx_queue.head = (tx_queue.head + 1) % TX_QUEUE_SLOTS;
+            tx_queue.count--;
+        }
+
+        struct tx_entry_t* entry = &tx_queue.entries[(tx_queue.head + tx_queue.count) % TX_QUEUE_SLOTS];
+
+        entry->buf = buf;
+        entry->size = size;
+        entry->timestamp = timestamp;
+        tx_queue.count++;
+        tx_queue.bytes += size;
+        tx_queue.high_water = MAX(tx_queue.high_water, tx_queue.bytes);
+        queued = true;
     } else {
-        LOG_WRN("Work item still pending");
+        tx_queue.dropped_epochs++;
+        tx_queue.dropped_bytes += size;
+        dropped_bytes = size;
+    }
+
+    bool shed_changed = update_shed_level();
+
+    k_spin_unlock(&tx_queue.lock, key);
+
+    if (shed_changed) {
+        k_work_reschedule(&link_work, K_NO_WAIT);
+    }
+
+    for (size_t i = 0; i < num_dropped; ++i) {
+        gnss_buf_unref(dropped[i]);
+    }
+
+    atomic_add(&link_dropped_bytes, dropped_bytes);
+
+    return queued;
+}
+
+static bool tx_queue_get(struct tx_entry_t* entry) {
+    k_spinlock_key_t key = k_spin_lock(&tx_queue.lock);
+    bool found = tx_queue.count > 0;
+
+    if (found) {
+        *entry = tx_queue.entries[tx_queue.head];
+        tx_queue.bytes -= entry->size;
+        tx_queue.head = (tx_queue.head + 1) % TX_QUEUE_SLOTS;
+        tx_queue.count--;
+    }
+
+    bool shed_changed = update_shed_level();
+
+    k_spin_unlock(&tx_queue.lock, key);
+
+    if (shed_changed) {
+        k_work_reschedule(&link_work, K_NO_WAIT);
+    }
+
+    return found;
+}
+
+// The rest of an epoch the link stalled part way through.
+static void tx_queue_count_dropped(size_t bytes) {
+    k_spinlock_key_t key = k_spin_lock(&tx_queue.lock);
+
+    tx_queue.dropped_bytes += bytes;
+    k_spin_unlock(&tx_queue.lock, key);
+
+    atomic_add(&link_dropped_bytes, bytes);
+}
+
+struct tx_queue_stats_t {
+    size_t bytes;
+    size_t high_water;
+    uint32_t dropped_epochs;
+    uint32_t dropped_bytes;
+};
+
+// A snapshot of the counters, which are cleared for the next report.
+static void tx_queue_get_stats(struct tx_queue_stats_t* stats) {
+    k_spinlock_key_t key = k_spin_lock(&tx_queue.lock);
+
+    stats->bytes = tx_queue.bytes;
+    stats->high_water = tx_queue.high_water;
+    stats->dropped_epochs = tx_queue.dropped_epochs;
+    stats->dropped_bytes = tx_queue.dropped_bytes;
+    tx_queue.high_water = tx_queue.bytes;
+    tx_queue.dropped_epochs = 0;
+    tx_queue.dropped_bytes = 0;
+
+    k_spin_unlock(&tx_queue.lock, key);
+}
+
+static void record_latency(uint32_t timestamp, size_t bytes, size_t notifications) {
+    uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - timestamp);
+
+    latency.count++;
+    latency.bytes += bytes;
+    latency.notifications += notifications;
+    latency.total_us += us;
+    latency.max_us = MAX(latency.max_us, us);
+
+    if (us > LATENCY_TARGET_US) {
+        latency.over_target++;
+    }
+
+    int64_t now = k_uptime_get();
+
+    if (now - latency.last_report < LATENCY_REPORT_INTERVAL_MS) {
+        return;
+    }
+
+    if (latency.count > 0) {
+        struct gnss_buf_stats_t buf_stats;
+        struct tx_queue_stats_t queue;
+
+        gnss_buf_get_stats(&buf_stats);
+        tx_queue_get_stats(&queue);
+        LOG_INF("Latency avg %u us, max %u us, %u of %u over %u us",
+                (uint32_t)(latency.total_us / latency.count), latency.max_us, latency.over_target, latency.count,
+                LATENCY_TARGET_US);
+        LOG_INF("TX queue %zu/%u bytes, high water %zu, %u epochs and %u bytes dropped", queue.bytes, TX_QUEUE_BYTES,
+                queue.high_water, queue.dropped_epochs, queue.dropped_bytes);
+        LOG_INF("Throughput %u bit/s in %u notifications, %u bytes each on average",
+                (uint32_t)((uint64_t)latency.bytes * 8 * 1000 / (now - latency.last_report)), latency.notifications,
+                latency.notifications > 0 ? latency.bytes / latency.notifications : 0);
+        LOG_INF("Buffers %u/%u in use, high water %u, %u allocation failures", buf_stats.in_use, buf_stats.count,
+                buf_stats.high_water, buf_stats.alloc_failures);
+#ifdef CONFIG_RFM9x
+        if (atomic_get(&lora_rover)) {
+            LOG_INF("LoRa received %u packets, %u bytes, %u lost, %u frames, %u dropped, last %d dBm %d dB SNR",
+                    (uint32_t)atomic_clear(&lora_rx_stats.packets), (uint32_t)atomic_clear(&lora_rx_stats.bytes),
+                    (uint32_t)atomic_clear(&lora_rx_stats.lost), (uint32_t)atomic_clear(&lora_rx_stats.frames),
+                    (uint32_t)atomic_clear(&lora_rx_stats.dropped), (int)atomic_get(&lora_rx_stats.rssi),
+                    (int)atomic_get(&lora_rx_stats.snr));
+        } else {
+            LOG_INF("LoRa %u packets, %u bytes, %u ms on air, %u failed, %u frames dropped",
+                    (uint32_t)atomic_clear(&lora_stats.packets), (uint32_t)atomic_clear(&lora_stats.bytes),
+                    (uint32_t)atomic_clear(&lora_stats.airtime_us) / 1000, (uint32_t)atomic_clear(&lora_stats.failed),
+                    (uint32_t)atomic_clear(&lora_stats.dropped));
+            LOG_INF("LoRa duty cycle %u of %u ms this hour, %u epochs held back, %u messages superseded",
+                    (uint32_t)atomic_get(&lora_stats.hour_us) / 1000, LORA_DUTY_BUDGET_US / 1000,
+                    (uint32_t)atomic_clear(&lora_stats.held_back), (uint32_t)atomic_clear(&lora_stats.superseded));
+        }
+#endif
+    }
+
+    latency = (struct latency_stats_t){.last_report = now};
+}
+
+// The biggest notification that fits the ATT MTU and fills whole link layer packets, so the last packet of each one
+// isn't sent mostly empty. With a 251 byte link layer that's 244 or 495 bytes rather than the MTU's 509.
+static size_t notification_size(size_t max_payload) {
+    size_t ll_len = atomic_get(&ll_tx_max_len);
+    size_t packets = (max_payload + NOTIFICATION_OVERHEAD) / ll_len;
+
+    if (packets == 0) {
+        return max_payload;
+    }
+
+    return MIN(max_payload, packets * ll_len - NOTIFICATION_OVERHEAD);
+}
+
+// 0 while nothing is connected.
+static size_t current_notification_size(void) {
+    struct bt_conn* conn = cur_conn;
+
+    return conn != NULL ? notification_size(MIN(bt_nus_get_mtu(conn), NUS_MAX_PAYLOAD)) : 0;
+}
+
+// Sends one epoch, a credit per notification. Returns how many notifications went out, and the bytes in them in sent.
+// If the link stalls the rest of the epoch is dropped and counted.
+static size_t send_epoch(struct net_buf* buf, size_t total, size_t* sent) {
+    // Only the io work queue touches this.
+    static uint8_t tx_buf[NUS_MAX_PAYLOAD];
+    size_t chunk = current_notification_size();
+    size_t notifications = 0;
+
+    *sent = 0;
+
+    // Nobody to send it to.
+    if (chunk == 0) {
+        return 0;
+    }
+
+    // Pool buffers are smaller than a notification can be, so they're gathered up to fill each one. Only the last
+    // one of an epoch can be short, it isn't held back for the next epoch as that would add a whole epoch of latency.
+    for (size_t offset = 0; offset < total; offset += chunk) {
+        if (k_sem_take(&tx_credits, K_MSEC(TX_CREDIT_TIMEOUT_MS)) != 0) {
+            LOG_WRN("BLE link stalled, dropping %zu bytes", total - offset);
+            tx_queue_count_dropped(total - offset);
+            break;
+        }
+
+        size_t len = net_buf_linearize(tx_buf, sizeof(tx_buf), buf, offset, chunk);
+
+        if (bt_nus_send(NULL, tx_buf, len) == 0) {
+            notifications++;
+            *sent += len;
+        } else {
+            // Nobody listening, so there'll be no sent callback for it.
+            k_sem_give(&tx_credits);
+        }
+    }
+
+    return notifications;
+}
+
+static void work_handler(struct k_work* work) {
+    ARG_UNUSED(work);
+
+    struct tx_entry_t entry;
+
+    while (tx_queue_get(&entry)) {
+        uint32_t start = k_cycle_get_32();
+        size_t sent;
+        size_t notifications = send_epoch(entry.buf, entry.size, &sent);
+
+        atomic_add(&link_busy_us, k_cyc_to_us_floor32(k_cycle_get_32() - start));
+        gnss_buf_unref(entry.buf);
+        record_latency(entry.timestamp, sent, notifications);
+    }
+}
+
+static bool handle_epoch_event(const struct epoch_event* event) {
+    if (tx_queue_put(gnss_buf_ref(event->buf), event->size, event->timestamp)) {
+        k_work_submit_to_queue(&io_work_queue, &tx_work);
+    } else {
+        LOG_WRN("Dropping a %d byte epoch, it's bigger than the TX queue", event->size);
+        gnss_buf_unref(event->buf);
     }
 
     return false;
@@ -149,6 +1209,16 @@ static void init() {
         module_set_state(MODULE_STATE_ERROR);
         return;
     }
+
+    k_work_queue_init(&lora_work_queue);
+    k_work_init(&lora_work, lora_work_handler);
+    k_work_init(&lora_role_work, lora_role_work_handler);
+    k_work_queue_start(&lora_work_queue, lora_worker_stack_area,
+                       K_THREAD_STACK_SIZEOF(lora_worker_stack_area), LORA_PRIORITY,
+                       NULL);
+    atomic_set(&lora_ready, 1);
+    // In case the config got here first.
+    k_work_submit_to_queue(&lora_work_queue, &lora_role_work);
 #endif
 
     if (!init_btuart()) {
@@ -157,9 +1227,9 @@ static void init() {
     }
 
     k_work_queue_init(&io_work_queue);
-    for (uint8_t i = 0; i < NUM_WORK_ITEMS; ++i) {
-        k_work_init(&io_work_items[i].work, work_handler);
-    }
+    k_work_init(&tx_work, work_handler);
+    link_window.start = k_uptime_get();
+    k_work_schedule(&link_work, K_MSEC(LINK_REPORT_INTERVAL_MS));
     k_work_queue_start(&io_work_queue, io_worker_stack_area,
                        K_THREAD_STACK_SIZEOF(io_worker_stack_area), WORKER_PRIORITY,
                        NULL);
@@ -176,9 +1246,19 @@ static bool io_app_event_handler(const struct app_event_header* aeh) {
         }
     }
 
+    if (is_epoch_event(aeh)) {
+        return handle_epoch_event(cast_epoch_event(aeh));
+    }
+
+#ifdef CONFIG_RFM9x
     if (is_gnss_event(aeh)) {
         return handle_gnss_event(cast_gnss_event(aeh));
     }
 
+    if (is_data_event(aeh)) {
+        return handle_data_event(cast_data_event(aeh));
+    }
+#endif
+
     return false;
 }
@@ -0,0 +1,218 @@
+#define MODULE survey
+
+#include "config.h"
+#include "events/data_event.h"
+#include "events/fix_event.h"
+#include "events/survey_event.h"
+
+#include <math.h>
+#include <caf/events/module_state_event.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(MODULE, LOG_LEVEL_DBG);
+
+// The survey stops once the fixes are at least this tightly grouped and it has been running for the minimum time, or
+// when it reaches the maximum time however they're grouped.
+#define SURVEY_TARGET_STD_DEV_M 2.0
+#define SURVEY_MIN_DURATION_S 300
+#define SURVEY_MAX_DURATION_S 3600
+#define SURVEY_LOG_INTERVAL_S 60
+
+// WGS84.
+#define WGS84_A 6378137.0
+#define WGS84_F (1.0 / 298.257223563)
+#define WGS84_E2 (WGS84_F * (2.0 - WGS84_F))
+
+// Welford's running mean and covariance, so a survey takes the same memory however long it runs. The fixes are taken
+// relative to the first one to keep the sums small enough not to lose precision.
+static struct survey_t {
+    bool running;
+    int64_t start_ms;
+    uint32_t next_log_s;
+    uint32_t n;
+    double origin[3];
+    double mean[3];
+    // Sums of the products of deviations from the mean: xx, yy, zz, xy, xz, yz.
+    double m2[6];
+} survey;
+
+static void geodetic_to_ecef(double latitude, double longitude, double height, double ecef[3]) {
+    double sin_lat = sin(latitude);
+    double cos_lat = cos(latitude);
+    double n = WGS84_A / sqrt(1.0 - WGS84_E2 * sin_lat * sin_lat);
+
+    ecef[0] = (n + height) * cos_lat * cos(longitude);
+    ecef[1] = (n + height) * cos_lat * sin(longitude);
+    ecef[2] = (n * (1.0 - WGS84_E2) + height) * sin_lat;
+}
+
+// Iterates the latitude, which settles to well under a millimetre in a handful of rounds anywhere but the poles.
+static void ecef_to_geodetic(const double ecef[3], double* latitude, double* longitude, double* height) {
+    double p = sqrt(ecef[0] * ecef[0] + ecef[1] * ecef[1]);
+    double lat = atan2(ecef[2], p * (1.0 - WGS84_E2));
+    double h = 0.0;
+
+    for (int i = 0; i < 5; ++i) {
+        double sin_lat = sin(lat);
+        double n = WGS84_A / sqrt(1.0 - WGS84_E2 * sin_lat * sin_lat);
+
+        h = p / cos(lat) - n;
+        lat = atan2(ecef[2], p * (1.0 - WGS84_E2 * n / (n + h)));
+    }
+
+    *latitude = lat;
+    *longitude = atan2(ecef[1], ecef[0]);
+    *height = h;
+}
+
+// The trace of the covariance doesn't depend on the axes, so this is the same in ECEF as it would be in local ENU.
+static double std_dev_3d(void) {
+    if (survey.n < 2) {
+        return INFINITY;
+    }
+
+    return sqrt((survey.m2[0] + survey.m2[1] + survey.m2[2]) / (survey.n - 1));
+}
+
+static void start_survey(void) {
+    memset(&survey, 0, sizeof(survey));
+    survey.running = true;
+    survey.start_ms = k_uptime_get();
+    survey.next_log_s = SURVEY_LOG_INTERVAL_S;
+    LOG_INF("Surveying in the base position");
+}
+
+static void add_sample(const double ecef[3]) {
+    double before[3];
+    double after[3];
+
+    if (survey.n == 0) {
+        memcpy(survey.origin, ecef, sizeof(survey.origin));
+    }
+
+    survey.n++;
+
+    for (int i = 0; i < 3; ++i) {
+        double x = ecef[i] - survey.origin[i];
+
+        before[i] = x - survey.mean[i];
+        survey.mean[i] += before[i] / survey.n;
+        after[i] = x - survey.mean[i];
+    }
+
+    survey.m2[0] += before[0] * after[0];
+    survey.m2[1] += before[1] * after[1];
+    survey.m2[2] += before[2] * after[2];
+    survey.m2[3] += before[0] * after[1];
+    survey.m2[4] += before[0] * after[2];
+    survey.m2[5] += before[1] * after[2];
+}
+
+static void finish_survey(double std_dev, uint32_t elapsed_s) {
+    double mean[3];
+    double latitude;
+    double longitude;
+    double height;
+
+    for (int i = 0; i < 3; ++i) {
+        mean[i] = survey.origin[i] + survey.mean[i];
+    }
+
+    ecef_to_geodetic(mean, &latitude, &longitude, &height);
+    survey.running = false;
+
+    LOG_DBG("Covariance xx=%.3f yy=%.3f zz=%.3f xy=%.3f xz=%.3f yz=%.3f m^2", survey.m2[0] / (survey.n - 1),
+            survey.m2[1] / (survey.n - 1), survey.m2[2] / (survey.n - 1), survey.m2[3] / (survey.n - 1),
+            survey.m2[4] / (survey.n - 1), survey.m2[5] / (survey.n - 1));
+
+    struct survey_event* event = new_survey_event();
+    event->latitude = latitude * 180.0 / M_PI;
+    event->longitude = longitude * 180.0 / M_PI;
+    event->height = (float)height;
+    event->std_dev = (float)std_dev;
+    event->samples = survey.n;
+    event->duration_s = elapsed_s;
+    APP_EVENT_SUBMIT(event);
+}
+
+static bool handle_fix_event(const struct fix_event* event) {
+    const struct px1122r_fix_t* fix = &event->fix;
+    double ecef[3];
+
+    // 3D fixes only, a 2D fix has a made up height.
+    if (!survey.running || fix->fix_mode < 2) {
+        return false;
+    }
+
+    // Navigation data comes with ECEF already, NMEA only has geodetic.
+    if (fix->sources & PX1122R_FIX_FROM_NAV_DATA) {
+        ecef[0] = fix->ecef_x / 100.0;
+        ecef[1] = fix->ecef_y / 100.0;
+        ecef[2] = fix->ecef_z / 100.0;
+    } else if (fix->sources & PX1122R_FIX_FROM_GGA) {
+        geodetic_to_ecef(fix->latitude * 1e-7 * M_PI / 180.0, fix->longitude * 1e-7 * M_PI / 180.0,
+                         fix->ellipsoid_height / 100.0, ecef);
+    } else {
+        return false;
+    }
+
+    add_sample(ecef);
+
+    uint32_t elapsed_s = (uint32_t)((k_uptime_get() - survey.start_ms) / 1000);
+    double std_dev = std_dev_3d();
+
+    if (elapsed_s >= SURVEY_MAX_DURATION_S) {
+        LOG_WRN("Survey ran out of time at %.2f m, using it anyway", std_dev);
+        finish_survey(std_dev, elapsed_s);
+    } else if (elapsed_s >= SURVEY_MIN_DURATION_S && std_dev <= SURVEY_TARGET_STD_DEV_M) {
+        LOG_INF("Survey done after %d s and %d fixes, %.2f m", elapsed_s, survey.n, std_dev);
+        finish_survey(std_dev, elapsed_s);
+    } else if (elapsed_s >= survey.next_log_s) {
+        LOG_DBG("Survey at %d s, %d fixes, %.2f m", elapsed_s, survey.n, std_dev);
+        survey.next_log_s += SURVEY_LOG_INTERVAL_S;
+    }
+
+    return false;
+}
+
+// A survey starts whenever a base has no position, and stops if one is set by hand or the unit becomes a rover. The
+// data module sends the config at boot, so a base that has never been given a position starts on its own.
+static bool handle_data_event(const struct data_event* event) {
+    bool wanted = event->config.role == ROLE_BASE && !config_has_base_position(&event->config);
+
+    if (wanted && !survey.running) {
+        start_survey();
+    } else if (!wanted && survey.running) {
+        LOG_INF("Base position set or no longer a base, abandoning the survey");
+        survey.running = false;
+    }
+
+    return false;
+}
+
+static bool app_event_handler(const struct app_event_header* aeh) {
+    if (is_module_state_event(aeh)) {
+        struct module_state_event* event = cast_module_state_event(aeh);
+
+        if (check_state(event, MODULE_ID(main), MODULE_STATE_READY)) {
+            module_set_state(MODULE_STATE_READY);
+        }
+
+        return false;
+    }
+
+    if (is_fix_event(aeh)) {
+        return handle_fix_event(cast_fix_event(aeh));
+    }
+
+    if (is_data_event(aeh)) {
+        return handle_data_event(cast_data_event(aeh));
+    }
+
+    return false;
+}
+
+APP_EVENT_LISTENER(MODULE, app_event_handler);
+APP_EVENT_SUBSCRIBE(MODULE, module_state_event);
+APP_EVENT_SUBSCRIBE(MODULE, data_event);
+APP_EVENT_SUBSCRIBE(MODULE, fix_event);